@@ -19,6 +19,7 @@
  * This work is licensed under the terms of the GNU LGPL, version 2.
  */
 #include <libcflat.h>
+#include <stats.h>
 #include <util.h>
 #include <asm/gic.h>
 #include <asm/gic-v3-its.h>
@@ -333,12 +334,22 @@ static void ticks_to_ns_time(uint64_t ticks, struct ns_time *ns_time)
 	ns_time->ns_frac = (ps % 1000) / 100;
 }
 
+static uint64_t ticks_to_ns(uint64_t ticks)
+{
+	struct ns_time ns_time;
+
+	ticks_to_ns_time(ticks, &ns_time);
+	return ns_time.ns;
+}
+
 static void loop_test(struct exit_test *test)
 {
-	uint64_t start, end, total_ticks, ntimes = 0;
+	uint64_t start, end, ticks, total_ticks, ntimes = 0;
 	struct ns_time avg_ns, total_ns = {};
+	static struct stats_hist hist;
 
 	total_ticks = 0;
+	stats_hist_init(&hist);
 	if (test->prep) {
 		if(!test->prep()) {
 			printf("%s test skipped\n", test->name);
@@ -356,6 +367,11 @@ static void loop_test(struct exit_test *test)
 		ntimes++;
 		total_ticks += (end - start);
 		ticks_to_ns_time(total_ticks, &total_ns);
+
+		ticks = end - start;
+		if (test->post)
+			test->post(1, &ticks);
+		stats_hist_add(&hist, ticks_to_ns(ticks));
 	}
 
 	if (test->post) {
@@ -368,6 +384,7 @@ static void loop_test(struct exit_test *test)
 
 	printf("%-30s%15" PRId64 ".%-15" PRId64 "%15" PRId64 ".%-15" PRId64 "\n",
 		test->name, total_ns.ns, total_ns.ns_frac, avg_ns.ns, avg_ns.ns_frac);
+	stats_hist_record(test->name, "ns", nr_cpus, &hist);
 }
 
 static void parse_args(int argc, char **argv)
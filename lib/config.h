@@ -0,0 +1,8 @@
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+/*
+ * Generated file. DO NOT MODIFY.
+ *
+ */
+
+#endif
@@ -8,10 +8,17 @@
 #include <libcflat.h>
 #include "migrate.h"
 
-/* static for now since we only support migrating exactly once per test. */
-static void migrate(void)
+/* Only migrating exactly once per test is supported. */
+static bool migrated;
+
+static void migrate_start(void)
 {
 	puts("Now migrate the VM, then press a key to continue...\n");
+}
+
+static void migrate(void)
+{
+	migrate_start();
 	(void)getchar();
 	report_info("Migration complete");
 }
@@ -24,11 +31,35 @@ static void migrate(void)
  */
 void migrate_once(void)
 {
-	static bool migrated;
-
 	if (migrated)
 		return;
 
 	migrated = true;
 	migrate();
 }
+
+/*
+ * Initiate migration and return without waiting for it, so that the test
+ * keeps running while the VM is migrated; poll migrate_background_done()
+ * to find out when it has completed.  Like migrate_once(), only the first
+ * call initiates a migration.
+ */
+void migrate_begin_background(void)
+{
+	if (migrated)
+		return;
+
+	migrated = true;
+	migrate_start();
+}
+
+bool migrate_background_done(void)
+{
+	static bool done;
+
+	if (!done && __getchar() != -1) {
+		done = true;
+		report_info("Migration complete");
+	}
+	return done;
+}
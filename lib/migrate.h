@@ -7,3 +7,5 @@
  */
 
 void migrate_once(void);
+void migrate_begin_background(void);
+bool migrate_background_done(void);
@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Latency statistics for micro-benchmarks
+ */
+#include <libcflat.h>
+#include <bitops.h>
+#include "stats.h"
+
+static unsigned int fls64(u64 val)
+{
+	if (upper_32_bits(val))
+		return 32 + fls(upper_32_bits(val));
+	return fls(lower_32_bits(val));
+}
+
+/*
+ * Values of STATS_SUB_BUCKETS and above are split by their most significant
+ * bit, which is implicit, and the STATS_SUB_BITS bits below it.
+ */
+static unsigned int stats_bucket(u64 val)
+{
+	unsigned int shift;
+
+	if (val < STATS_SUB_BUCKETS)
+		return val;
+
+	shift = fls64(val) - 1 - STATS_SUB_BITS;
+	return MIN((shift + 1) * STATS_SUB_BUCKETS +
+		   ((val >> shift) & (STATS_SUB_BUCKETS - 1)),
+		   STATS_NR_BUCKETS - 1);
+}
+
+/* The smallest value that falls into bucket @idx. */
+static u64 stats_bucket_base(unsigned int idx)
+{
+	unsigned int shift;
+	u64 sub;
+
+	if (idx < STATS_SUB_BUCKETS)
+		return idx;
+
+	shift = idx / STATS_SUB_BUCKETS - 1;
+	sub = idx % STATS_SUB_BUCKETS;
+	return ((u64)STATS_SUB_BUCKETS | sub) << shift;
+}
+
+void stats_hist_init(struct stats_hist *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = ~0ull;
+}
+
+void stats_hist_add(struct stats_hist *h, u64 val)
+{
+	h->count++;
+	h->sum += val;
+	if (val < h->min)
+		h->min = val;
+	if (val > h->max)
+		h->max = val;
+	h->buckets[stats_bucket(val)]++;
+}
+
+void stats_hist_merge(struct stats_hist *dst, const struct stats_hist *src)
+{
+	int i;
+
+	if (!src->count)
+		return;
+
+	dst->count += src->count;
+	dst->sum += src->sum;
+	dst->min = MIN(dst->min, src->min);
+	dst->max = MAX(dst->max, src->max);
+	for (i = 0; i < STATS_NR_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+}
+
+u64 stats_hist_mean(const struct stats_hist *h)
+{
+	return h->count ? h->sum / h->count : 0;
+}
+
+u64 stats_hist_percentile(const struct stats_hist *h, unsigned int permille)
+{
+	u64 rank, seen = 0;
+	int i;
+
+	if (!h->count)
+		return 0;
+
+	rank = (h->count * permille + 999) / 1000;
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < STATS_NR_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank)
+			return MIN(MAX(stats_bucket_base(i), h->min), h->max);
+	}
+	return h->max;
+}
+
+void stats_hist_summarize(const struct stats_hist *h, struct stats_summary *s)
+{
+	s->count = h->count;
+	s->min = h->count ? h->min : 0;
+	s->mean = stats_hist_mean(h);
+	s->p50 = stats_hist_percentile(h, 500);
+	s->p90 = stats_hist_percentile(h, 900);
+	s->p99 = stats_hist_percentile(h, 990);
+	s->p999 = stats_hist_percentile(h, 999);
+	s->max = h->max;
+}
+
+void stats_summary_print(const char *name, const char *unit,
+			 const struct stats_summary *s)
+{
+	if (!s->count)
+		return;
+
+	printf("%s: min %" PRIu64 " p50 %" PRIu64 " p90 %" PRIu64
+	       " p99 %" PRIu64 " p99.9 %" PRIu64 " max %" PRIu64 " %s\n",
+	       name, s->min, s->p50, s->p90, s->p99, s->p999, s->max, unit);
+}
+
+void stats_hist_print(const char *name, const char *unit,
+		      const struct stats_hist *h)
+{
+	struct stats_summary s;
+
+	stats_hist_summarize(h, &s);
+	stats_summary_print(name, unit, &s);
+}
+
+void stats_summary_record(const char *name, const char *unit, int nr_cpus,
+			  const struct stats_summary *s)
+{
+	const char *accel = getenv("QEMU_ACCEL");
+
+	if (!s->count)
+		return;
+
+	if (!accel || !*accel)
+		accel = "unknown";
+
+	printf(STATS_RECORD_MARKER "{\"name\":\"%s\",\"unit\":\"%s\","
+	       "\"iterations\":%" PRIu64 ",\"cpus\":%d,\"accel\":\"%s\","
+	       "\"min\":%" PRIu64 ",\"mean\":%" PRIu64 ",\"p50\":%" PRIu64
+	       ",\"p90\":%" PRIu64 ",\"p99\":%" PRIu64 ",\"p99.9\":%" PRIu64
+	       ",\"max\":%" PRIu64 "}\n",
+	       name, unit, s->count, nr_cpus, accel, s->min, s->mean,
+	       s->p50, s->p90, s->p99, s->p999, s->max);
+}
+
+void stats_hist_record(const char *name, const char *unit, int nr_cpus,
+		       const struct stats_hist *h)
+{
+	struct stats_summary s;
+
+	stats_hist_summarize(h, &s);
+	stats_summary_record(name, unit, nr_cpus, &s);
+}
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Latency statistics for micro-benchmarks
+ *
+ * Samples are accumulated into a fixed-size log-linear histogram, so
+ * recording is O(1), needs no allocation and percentiles can be
+ * reported without keeping every sample around.  Values below
+ * STATS_SUB_BUCKETS are counted exactly; above that, every power of two
+ * is split into STATS_SUB_BUCKETS linear buckets, which bounds the
+ * relative error of a reported percentile to 1/STATS_SUB_BUCKETS.
+ */
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <libcflat.h>
+
+#define STATS_SUB_BITS		4
+#define STATS_SUB_BUCKETS	(1 << STATS_SUB_BITS)
+#define STATS_NR_BUCKETS	((64 - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS)
+
+struct stats_hist {
+	u64 count;
+	u64 sum;
+	u64 min;
+	u64 max;
+	u64 buckets[STATS_NR_BUCKETS];
+};
+
+void stats_hist_init(struct stats_hist *h);
+void stats_hist_add(struct stats_hist *h, u64 val);
+void stats_hist_merge(struct stats_hist *dst, const struct stats_hist *src);
+u64 stats_hist_mean(const struct stats_hist *h);
+
+/*
+ * Return the smallest recorded value such that at least @permille/1000
+ * of the samples are less than or equal to it, e.g. 990 for p99 and
+ * 999 for p99.9.  The result is the lower bound of the bucket, clamped
+ * to the exact minimum and maximum.
+ */
+u64 stats_hist_percentile(const struct stats_hist *h, unsigned int permille);
+
+/*
+ * The statistics that are printed and recorded for a histogram, so that
+ * callers can convert them to another unit before reporting them.
+ */
+struct stats_summary {
+	u64 count;
+	u64 min;
+	u64 mean;
+	u64 p50;
+	u64 p90;
+	u64 p99;
+	u64 p999;
+	u64 max;
+};
+
+void stats_hist_summarize(const struct stats_hist *h, struct stats_summary *s);
+
+/*
+ * Print "@name: min .. p50 .. p90 .. p99 .. p99.9 .. max .. @unit", or
+ * nothing if no samples were recorded.
+ */
+void stats_summary_print(const char *name, const char *unit,
+			 const struct stats_summary *s);
+void stats_hist_print(const char *name, const char *unit,
+		      const struct stats_hist *h);
+
+/*
+ * Print a machine-readable result record for the benchmark @name, for
+ * consumption by scripts/bench_compare.py.  Records are a single line of
+ * JSON prefixed with STATS_RECORD_MARKER, e.g.
+ *
+ *   BENCH: {"name":"cpuid","unit":"cycles","iterations":1024,"cpus":4,
+ *           "accel":"kvm","min":..,"mean":..,"p50":..,"p90":..,"p99":..,
+ *           "p99.9":..,"max":..}
+ *
+ * @nr_cpus is the number of vCPUs in the guest; the accelerator is taken
+ * from the QEMU_ACCEL environment variable provided by the run scripts.
+ * A @unit ending in "/s" marks a rate, which the comparator treats as
+ * better when larger; any other unit is a cost.
+ */
+#define STATS_RECORD_MARKER	"BENCH: "
+
+void stats_summary_record(const char *name, const char *unit, int nr_cpus,
+			  const struct stats_summary *s);
+void stats_hist_record(const char *name, const char *unit, int nr_cpus,
+		       const struct stats_hist *h);
+
+#endif
@@ -84,6 +84,26 @@ void puts(const char *s)
 	spin_unlock(&lock);
 }
 
+int __getchar(void)
+{
+	int c = -1;
+
+	spin_lock(&lock);
+#ifdef USE_SERIAL
+	if (!serial_inited) {
+		serial_init();
+		serial_inited = 1;
+	}
+
+	/* LSR: data ready */
+	if (inb(serial_iobase + 0x05) & 0x01)
+		c = inb(serial_iobase + 0x00);
+#endif
+	spin_unlock(&lock);
+
+	return c;
+}
+
 void exit(int code)
 {
 #ifdef USE_SERIAL
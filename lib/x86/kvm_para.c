@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * KVM paravirtual interface
+ */
+#include "libcflat.h"
+#include "processor.h"
+#include "kvm_para.h"
+
+static int use_vmmcall = -1;
+
+bool kvm_para_available(void)
+{
+	struct cpuid c;
+	u32 sig[3];
+
+	/* CPUID.1:ECX[31] is the hypervisor present bit. */
+	if (!(cpuid(1).c & BIT(31)))
+		return false;
+
+	c = raw_cpuid(KVM_CPUID_SIGNATURE, 0);
+	sig[0] = c.b;
+	sig[1] = c.c;
+	sig[2] = c.d;
+	return !memcmp(sig, "KVMKVMKVM\0\0\0", 12);
+}
+
+bool kvm_para_has_feature(unsigned int feature)
+{
+	return kvm_para_available() &&
+	       (raw_cpuid(KVM_CPUID_FEATURES, 0).a & BIT(feature));
+}
+
+long kvm_hypercall(unsigned int nr, unsigned long a0, unsigned long a1,
+		   unsigned long a2, unsigned long a3)
+{
+	long ret;
+
+	if (use_vmmcall < 0)
+		use_vmmcall = !is_intel();
+
+	if (use_vmmcall)
+		asm volatile ("vmmcall"
+			      : "=a"(ret)
+			      : "a"(nr), "b"(a0), "c"(a1), "d"(a2), "S"(a3)
+			      : "memory");
+	else
+		asm volatile ("vmcall"
+			      : "=a"(ret)
+			      : "a"(nr), "b"(a0), "c"(a1), "d"(a2), "S"(a3)
+			      : "memory");
+	return ret;
+}
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef _X86_KVM_PARA_H_
+#define _X86_KVM_PARA_H_
+
+#include "libcflat.h"
+
+#define KVM_CPUID_SIGNATURE	0x40000000
+#define KVM_CPUID_FEATURES	0x40000001
+#define KVM_CPUID_TIMING	0x40000010
+
+/* Bits of KVM_CPUID_FEATURES.EAX */
+#define KVM_FEATURE_CLOCKSOURCE2	3
+#define KVM_FEATURE_PV_UNHALT		7
+#define KVM_FEATURE_PV_SEND_IPI		11
+#define KVM_FEATURE_PV_SCHED_YIELD	13
+
+#define KVM_HC_KICK_CPU		5
+#define KVM_HC_SEND_IPI		10
+#define KVM_HC_SCHED_YIELD	11
+
+/* True if running on KVM, as reported by the hypervisor CPUID leaves. */
+bool kvm_para_available(void);
+bool kvm_para_has_feature(unsigned int feature);
+
+/*
+ * Issue hypercall @nr with VMCALL or VMMCALL depending on the CPU vendor,
+ * so that KVM does not have to patch the instruction.
+ */
+long kvm_hypercall(unsigned int nr, unsigned long a0, unsigned long a1,
+		   unsigned long a2, unsigned long a3);
+
+#endif
@@ -0,0 +1,167 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * TSC frequency calibration
+ */
+#include "libcflat.h"
+#include "processor.h"
+#include "kvm_para.h"
+#include "tsc.h"
+
+#define MSR_KVM_SYSTEM_TIME_NEW	0x4b564d01
+
+/* Same layout as struct pvclock_vcpu_time_info in x86/kvmclock.h. */
+struct pvclock_info {
+	u32 version;
+	u32 pad0;
+	u64 tsc_timestamp;
+	u64 system_time;
+	u32 tsc_to_system_mul;
+	s8 tsc_shift;
+	u8 flags;
+	u8 pad[2];
+} __attribute__((__packed__));
+
+static u64 hz;
+static const char *source;
+
+static u64 kvm_timing_hz(void)
+{
+	if (!kvm_para_available())
+		return 0;
+
+	/* EAX is the TSC frequency in kHz. */
+	return (u64)cpuid(KVM_CPUID_TIMING).a * 1000;
+}
+
+/*
+ * kvmclock converts TSC deltas to nanoseconds as
+ * ((delta << tsc_shift) * tsc_to_system_mul) >> 32, invert that.
+ */
+static u64 kvmclock_hz(void)
+{
+	static struct pvclock_info pvclock __attribute__((aligned(32)));
+	u64 freq, old;
+	u32 version, mul;
+	s8 shift;
+
+	if (!kvm_para_has_feature(KVM_FEATURE_CLOCKSOURCE2))
+		return 0;
+
+	/* Borrow this vCPU's kvmclock, the test may have enabled its own. */
+	old = rdmsr(MSR_KVM_SYSTEM_TIME_NEW);
+	wrmsr(MSR_KVM_SYSTEM_TIME_NEW, (unsigned long)&pvclock | 1);
+	do {
+		version = pvclock.version;
+		barrier();
+		mul = pvclock.tsc_to_system_mul;
+		shift = pvclock.tsc_shift;
+		barrier();
+	} while ((version & 1) || version != pvclock.version);
+	wrmsr(MSR_KVM_SYSTEM_TIME_NEW, old);
+
+	if (!mul)
+		return 0;
+
+	freq = ((u64)NSEC_PER_SEC << 32) / mul;
+	return shift < 0 ? freq << -shift : freq >> shift;
+}
+
+static u64 cpuid_15_hz(void)
+{
+	struct cpuid c = cpuid(0x15);
+
+	/* EBX/EAX is the TSC/crystal ratio, ECX the crystal frequency. */
+	if (!c.a || !c.b || !c.c)
+		return 0;
+
+	return (u64)c.c * c.b / c.a;
+}
+
+static u64 cpuid_16_hz(void)
+{
+	/* EAX is the base frequency in MHz. */
+	return (u64)(cpuid(0x16).a & 0xffff) * 1000000;
+}
+
+static void tsc_calibrate(void)
+{
+	static const struct {
+		const char *name;
+		u64 (*get)(void);
+	} sources[] = {
+		{ "cpuid 0x40000010", kvm_timing_hz },
+		{ "kvmclock", kvmclock_hz },
+		{ "cpuid 0x15", cpuid_15_hz },
+		{ "cpuid 0x16", cpuid_16_hz },
+	};
+	int i;
+
+	source = "none";
+	for (i = 0; i < ARRAY_SIZE(sources); i++) {
+		hz = sources[i].get();
+		if (hz) {
+			source = sources[i].name;
+			break;
+		}
+	}
+}
+
+u64 tsc_hz(void)
+{
+	if (!source)
+		tsc_calibrate();
+	return hz;
+}
+
+const char *tsc_hz_source(void)
+{
+	if (!source)
+		tsc_calibrate();
+	return source;
+}
+
+u64 tsc_to_ns(u64 cycles)
+{
+	u64 freq = tsc_hz();
+
+	if (!freq)
+		return 0;
+
+	/* Split the multiplication so that it cannot overflow. */
+	return cycles / freq * NSEC_PER_SEC +
+	       cycles % freq * NSEC_PER_SEC / freq;
+}
+
+static bool summary_to_ns(const struct stats_hist *h, struct stats_summary *s)
+{
+	stats_hist_summarize(h, s);
+	if (!tsc_hz())
+		return false;
+
+	s->min = tsc_to_ns(s->min);
+	s->mean = tsc_to_ns(s->mean);
+	s->p50 = tsc_to_ns(s->p50);
+	s->p90 = tsc_to_ns(s->p90);
+	s->p99 = tsc_to_ns(s->p99);
+	s->p999 = tsc_to_ns(s->p999);
+	s->max = tsc_to_ns(s->max);
+	return true;
+}
+
+void tsc_hist_print(const char *name, const struct stats_hist *h)
+{
+	struct stats_summary s;
+
+	stats_hist_print(name, "cycles", h);
+	if (summary_to_ns(h, &s))
+		stats_summary_print(name, "ns", &s);
+}
+
+void tsc_hist_record(const char *name, int nr_cpus, const struct stats_hist *h)
+{
+	struct stats_summary s;
+
+	stats_hist_record(name, "cycles", nr_cpus, h);
+	if (summary_to_ns(h, &s))
+		stats_summary_record(name, "ns", nr_cpus, &s);
+}
@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef _X86_TSC_H_
+#define _X86_TSC_H_
+
+#include "libcflat.h"
+#include "stats.h"
+
+#ifndef NSEC_PER_SEC
+#define NSEC_PER_SEC	1000000000ULL
+#endif
+
+/*
+ * Return the TSC frequency in Hz, or 0 if it cannot be determined.  The
+ * frequency is taken, in order of preference, from the KVM timing leaf
+ * (CPUID 0x40000010), from the kvmclock scale factor, from CPUID 0x15
+ * (TSC/crystal ratio) and from CPUID 0x16 (base frequency).  The result
+ * is computed on the first call and cached.
+ */
+u64 tsc_hz(void);
+
+/* Where tsc_hz() got the frequency from, "none" if unknown. */
+const char *tsc_hz_source(void);
+
+/* Convert TSC cycles to nanoseconds, returns 0 if tsc_hz() is unknown. */
+u64 tsc_to_ns(u64 cycles);
+
+/*
+ * Print and record a histogram of TSC deltas, in cycles and, if the TSC
+ * frequency is known, also in nanoseconds.
+ */
+void tsc_hist_print(const char *name, const struct stats_hist *h);
+void tsc_hist_record(const char *name, int nr_cpus,
+		     const struct stats_hist *h);
+
+#endif
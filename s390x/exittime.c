@@ -9,6 +9,7 @@
  *  Nico Boehr <nrb@linux.ibm.com>
  */
 #include <libcflat.h>
+#include <stats.h>
 #include <smp.h>
 #include <sclp.h>
 #include <hardware.h>
@@ -227,6 +228,11 @@ static uint64_t tod_to_ns(uint64_t tod)
 	return tod_to_us(tod * 1000);
 }
 
+static uint64_t tod_to_ps(uint64_t tod)
+{
+	return tod_to_us(tod * 1000 * 1000);
+}
+
 static uint64_t normalize_iters(uint64_t value_to_normalize, uint64_t iters)
 {
 	return value_to_normalize * iters_to_normalize_to / iters;
@@ -254,6 +260,7 @@ int main(void)
 	const int outer_iters = 100;
 	struct test const *current_test;
 	struct test_result result;
+	static struct stats_hist hist;
 	uint64_t start, end, elapsed;
 
 	report_prefix_push("exittime");
@@ -264,6 +271,7 @@ int main(void)
 		result.total = 0;
 		result.worst = 0;
 		result.best = -1;
+		stats_hist_init(&hist);
 		report_prefix_pushf("%s", current_test->name);
 
 		if (host_is_tcg() && !current_test->supports_tcg) {
@@ -285,9 +293,12 @@ int main(void)
 			result.best = MIN(result.best, elapsed);
 			result.worst = MAX(result.worst, elapsed);
 			result.total += elapsed;
+			/* picoseconds, as many of the instructions take less than 1ns */
+			stats_hist_add(&hist, tod_to_ps(elapsed) / current_test->iters);
 		}
 		result.average = result.total / outer_iters;
 		report_iteration_result(current_test, &result);
+		stats_hist_record(current_test->name, "ps", smp_query_num_cpus(), &hist);
 		report_prefix_pop();
 	}
 
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+#
+# Compare the benchmark result records of two sets of runs and flag
+# regressions.
+#
+# Benchmarks built on lib/stats.c print one "BENCH: {json}" line per
+# measurement.  Each side of the comparison is a console log, or a
+# directory of logs such as the logs/ directory written by run_tests.sh.
+# When a side contains several records for the same benchmark (e.g. the
+# logs of repeated runs were concatenated), the difference of the chosen
+# metric is checked for statistical significance with Welch's t-test;
+# with a single record per side only the relative change is checked.
+#
+# Records whose unit is a rate ("MB/s", ...) are throughputs, for which
+# larger is better; all other units are costs such as latencies.
+#
+# Usage: bench_compare.py [options] BASE NEW
+#
+# Exit status is 1 if any benchmark regressed, 0 otherwise.
+
+import argparse
+import json
+import math
+import os
+import sys
+
+MARKER = 'BENCH: '
+
+def read_records(path):
+    files = []
+    if os.path.isdir(path):
+        for name in sorted(os.listdir(path)):
+            files.append(os.path.join(path, name))
+    else:
+        files.append(path)
+
+    records = {}
+    for f in files:
+        with open(f, errors='replace') as fp:
+            for line in fp:
+                pos = line.find(MARKER)
+                if pos < 0:
+                    continue
+                try:
+                    rec = json.loads(line[pos + len(MARKER):])
+                except ValueError:
+                    continue
+                key = (rec['name'], rec.get('unit'), rec.get('cpus'),
+                       rec.get('accel'))
+                records.setdefault(key, []).append(rec)
+    return records
+
+def higher_is_better(unit):
+    return unit is not None and unit.endswith('/s')
+
+def mean_var(samples):
+    n = len(samples)
+    mean = sum(samples) / n
+    var = sum((x - mean) ** 2 for x in samples) / (n - 1)
+    return mean, var
+
+# Continued fraction for the regularized incomplete beta function, see
+# Numerical Recipes, 6.4.
+def betacf(a, b, x):
+    qab, qap, qam = a + b, a + 1.0, a - 1.0
+    c, d = 1.0, 1.0 - qab * x / qap
+    d = 1.0 / (d if abs(d) > 1e-30 else 1e-30)
+    h = d
+    for m in range(1, 201):
+        m2 = 2 * m
+        aa = m * (b - m) * x / ((qam + m2) * (a + m2))
+        d = 1.0 + aa * d
+        d = 1.0 / (d if abs(d) > 1e-30 else 1e-30)
+        c = 1.0 + aa / c
+        c = c if abs(c) > 1e-30 else 1e-30
+        h *= d * c
+        aa = -(a + m) * (qab + m) * x / ((a + m2) * (qap + m2))
+        d = 1.0 + aa * d
+        d = 1.0 / (d if abs(d) > 1e-30 else 1e-30)
+        c = 1.0 + aa / c
+        c = c if abs(c) > 1e-30 else 1e-30
+        delta = d * c
+        h *= delta
+        if abs(delta - 1.0) < 1e-12:
+            break
+    return h
+
+def betai(a, b, x):
+    if x <= 0.0:
+        return 0.0
+    if x >= 1.0:
+        return 1.0
+    bt = math.exp(math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b) +
+                  a * math.log(x) + b * math.log(1.0 - x))
+    if x < (a + 1.0) / (a + b + 2.0):
+        return bt * betacf(a, b, x) / a
+    return 1.0 - bt * betacf(b, a, 1.0 - x) / b
+
+# Two-sided p-value of Welch's t-test.
+def welch_p(base, new):
+    mb, vb = mean_var(base)
+    mn, vn = mean_var(new)
+    sb, sn = vb / len(base), vn / len(new)
+    if sb + sn == 0:
+        return 0.0 if mb != mn else 1.0
+    t = (mn - mb) / math.sqrt(sb + sn)
+    df = (sb + sn) ** 2 / (sb ** 2 / (len(base) - 1) + sn ** 2 / (len(new) - 1))
+    return betai(df / 2.0, 0.5, df / (df + t * t))
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Compare benchmark result records of two runs.')
+    parser.add_argument('base', help='baseline log file or directory')
+    parser.add_argument('new', help='new log file or directory')
+    parser.add_argument('-m', '--metric', default='p50',
+                        help='statistic to compare (default: p50)')
+    parser.add_argument('-t', '--threshold', type=float, default=5.0,
+                        help='minimum relative change in percent (default: 5)')
+    parser.add_argument('-a', '--alpha', type=float, default=0.05,
+                        help='significance level (default: 0.05)')
+    args = parser.parse_args()
+
+    base = read_records(args.base)
+    new = read_records(args.new)
+    regressions = 0
+
+    print('%-40s %6s %5s %14s %14s %9s %8s  %s' %
+          ('name', 'unit', 'cpus', 'base', 'new', 'change', 'p-value',
+           'verdict'))
+    for key in sorted(set(base) | set(new), key=str):
+        name, unit, cpus, _ = key
+        if key not in base or key not in new:
+            print('%-40s %6s %5s %s' % (name, unit, cpus,
+                  'only in ' + ('new' if key in new else 'base')))
+            continue
+
+        b = [r[args.metric] for r in base[key] if args.metric in r]
+        n = [r[args.metric] for r in new[key] if args.metric in r]
+        if not b or not n:
+            continue
+
+        mb, mn = sum(b) / len(b), sum(n) / len(n)
+        change = (mn - mb) * 100.0 / mb if mb else 0.0
+        if len(b) > 1 and len(n) > 1:
+            p = welch_p(b, n)
+            pstr = '%.4f' % p
+        else:
+            p = 0.0
+            pstr = '-'
+
+        verdict = ''
+        if abs(change) >= args.threshold and p < args.alpha:
+            if (change > 0) != higher_is_better(unit):
+                verdict = 'REGRESSION'
+                regressions += 1
+            else:
+                verdict = 'improvement'
+
+        print('%-40s %6s %5s %14.1f %14.1f %+8.1f%% %8s  %s' %
+              (name, unit, cpus, mb, mn, change, pstr, verdict))
+
+    return 1 if regressions else 0
+
+if __name__ == '__main__':
+    sys.exit(main())
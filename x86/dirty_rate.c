@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Dirty memory at a given rate while the VM is migrated
+ *
+ * Every vCPU owns a slice of a memory region and writes to one word of
+ * a page of its slice at a time, at an equal share of the requested rate.
+ * The pages are chosen by one of these patterns:
+ *
+ * - seq:    each vCPU walks its slice sequentially, wrapping around.
+ * - random: uniformly random pages of the slice.
+ * - hot:    uniformly random pages of a hot set at the start of the slice,
+ *           the vCPUs' hot sets adding up to the given working set size.
+ *
+ * vCPU0 asks for migration once all pages were written, reports the rate
+ * that was actually achieved in every 100ms interval until the migration
+ * completes, and then checks that every page still holds its own index and
+ * the sequence number of the last write to it, so that writes lost by dirty
+ * tracking are caught.
+ * The largest gap between two writes of a vCPU, usually the downtime, is
+ * reported together with the other gaps.  Dirty logging, the dirty ring
+ * and auto-converge are configured on the host and in QEMU; throttling by
+ * auto-converge shows up as a drop of the achieved rate.
+ *
+ * Usage: dirty_rate.flat [seq|random|hot] [MB/s, 0 for no limit, default 16]
+ *                        [memory MB, default 32] [working set MB, default 4]
+ */
+#include "libcflat.h"
+#include "alloc.h"
+#include "migrate.h"
+#include "processor.h"
+#include "smp.h"
+#include "stats.h"
+#include "tsc.h"
+#include "vm.h"
+
+#define SAMPLE_MS	100
+
+enum pattern {
+	PATTERN_SEQ,
+	PATTERN_RANDOM,
+	PATTERN_HOT,
+};
+
+static const char *pattern_names[] = {
+	[PATTERN_SEQ] = "seq",
+	[PATTERN_RANDOM] = "random",
+	[PATTERN_HOT] = "hot",
+};
+
+struct dirtier {
+	unsigned long first;	/* index of the first page of the slice */
+	unsigned long pages;	/* pages in the slice */
+	unsigned long hot;	/* pages in the hot set */
+	unsigned long next;
+	u64 rng;
+	volatile u64 dirtied;
+	struct stats_hist gaps;
+} __attribute__((aligned(64)));
+
+static enum pattern pattern;
+static int nr_cpus;
+static u8 *mem;
+static unsigned long nr_pages;
+static struct dirtier *dirtiers;
+static u32 *last_seq;		/* per page, as written by its vCPU */
+static u64 page_cycles;		/* between two writes of a vCPU, 0 = no limit */
+static u64 sample_cycles;
+static volatile bool stop;
+
+static struct stats_hist rate_hist;
+
+/* xorshift64, seeded per vCPU. */
+static u64 next_random(struct dirtier *d)
+{
+	d->rng ^= d->rng << 13;
+	d->rng ^= d->rng >> 7;
+	d->rng ^= d->rng << 17;
+	return d->rng;
+}
+
+static unsigned long next_page(struct dirtier *d)
+{
+	switch (pattern) {
+	case PATTERN_RANDOM:
+		return next_random(d) % d->pages;
+	case PATTERN_HOT:
+		return next_random(d) % d->hot;
+	default:
+		d->next = (d->next + 1) % d->pages;
+		return d->next;
+	}
+}
+
+/*
+ * The upper half of the word is the index of the page it was written to,
+ * the lower half the sequence number of the write.  Only the vCPU owning
+ * the page writes it, so last_seq needs no locking.
+ */
+static void write_page(unsigned long page, u64 seq)
+{
+	*(volatile u64 *)(mem + page * PAGE_SIZE) = (u64)page << 32 | (u32)seq;
+	last_seq[page] = seq;
+}
+
+static u64 total_dirtied(void)
+{
+	u64 total = 0;
+	int cpu;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		total += dirtiers[cpu].dirtied;
+	return total;
+}
+
+/* On vCPU0, sample the achieved rate and poll for the end of migration. */
+static void sample(u64 now, u64 *last_sample, u64 *last_total)
+{
+	u64 total = total_dirtied(), bytes;
+
+	bytes = (total - *last_total) * PAGE_SIZE;
+	stats_hist_add(&rate_hist,
+		       bytes * tsc_hz() / (now - *last_sample) >> 20);
+	*last_sample = now;
+	*last_total = total;
+
+	if (migrate_background_done())
+		stop = true;
+}
+
+static void dirty(void *data)
+{
+	struct dirtier *d = data;
+	u64 now, last, deadline, last_sample, last_total = 0;
+	bool bsp = d == &dirtiers[0];
+	u64 seq = 0;
+
+	last = deadline = last_sample = rdtsc();
+	while (!stop) {
+		write_page(d->first + next_page(d), ++seq);
+		d->dirtied++;
+
+		now = rdtsc();
+		stats_hist_add(&d->gaps, now - last);
+
+		if (page_cycles) {
+			/* Do not catch up after a stall, e.g. the downtime. */
+			deadline = MAX(deadline + page_cycles, now);
+			while ((now = rdtsc()) < deadline)
+				pause();
+		}
+		last = now;
+
+		if (bsp && now - last_sample >= sample_cycles)
+			sample(now, &last_sample, &last_total);
+	}
+}
+
+static void prefault(void *data)
+{
+	struct dirtier *d = data;
+	unsigned long i;
+
+	for (i = 0; i < d->pages; i++)
+		write_page(d->first + i, 0);
+}
+
+static void run_on_all(void (*fn)(void *))
+{
+	int cpu;
+
+	for (cpu = 1; cpu < nr_cpus; cpu++)
+		on_cpu_async(cpu, fn, &dirtiers[cpu]);
+	fn(&dirtiers[0]);
+	while (cpus_active() > 1)
+		pause();
+}
+
+static enum pattern parse_pattern(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(pattern_names); i++)
+		if (!strcmp(name, pattern_names[i]))
+			return i;
+
+	report_abort("unknown pattern '%s'", name);
+	return PATTERN_SEQ;
+}
+
+int main(int ac, char **av)
+{
+	static struct stats_hist gaps;
+	unsigned long mb = 32, hot_mb = 4, rate = 16, i, errors = 0;
+	char name[64];
+	u64 start, elapsed;
+	int cpu;
+
+	setup_vm();
+	nr_cpus = cpu_count();
+
+	if (ac > 1)
+		pattern = parse_pattern(av[1]);
+	if (ac > 2)
+		rate = atol(av[2]);
+	if (ac > 3)
+		mb = atol(av[3]);
+	if (ac > 4)
+		hot_mb = atol(av[4]);
+
+	nr_pages = (mb << 20) / PAGE_SIZE;
+	if (!tsc_hz() || nr_pages < nr_cpus ||
+	    (pattern == PATTERN_HOT && (!hot_mb || hot_mb > mb))) {
+		report_skip(!tsc_hz() ? "TSC frequency unknown" :
+			    "invalid memory or working set size");
+		migrate_once();
+		return report_summary();
+	}
+
+	mem = memalign(PAGE_SIZE, nr_pages * PAGE_SIZE);
+	assert(mem);
+	last_seq = calloc(nr_pages, sizeof(*last_seq));
+	assert(last_seq);
+	dirtiers = memalign(__alignof__(*dirtiers),
+			    nr_cpus * sizeof(*dirtiers));
+	assert(dirtiers);
+	memset(dirtiers, 0, nr_cpus * sizeof(*dirtiers));
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		struct dirtier *d = &dirtiers[cpu];
+
+		d->first = nr_pages * cpu / nr_cpus;
+		d->pages = nr_pages * (cpu + 1) / nr_cpus - d->first;
+		d->hot = MAX(MIN((hot_mb << 20) / PAGE_SIZE / nr_cpus,
+				 d->pages), 1ul);
+		d->next = d->pages - 1;
+		d->rng = 0x9e3779b97f4a7c15ull * (cpu + 1);
+		stats_hist_init(&d->gaps);
+	}
+
+	if (rate)
+		page_cycles = tsc_hz() * PAGE_SIZE * nr_cpus / (rate << 20);
+	sample_cycles = tsc_hz() / 1000 * SAMPLE_MS;
+	stats_hist_init(&rate_hist);
+
+	printf("TSC frequency %" PRIu64 " kHz (%s)\n", tsc_hz() / 1000,
+	       tsc_hz_source());
+	printf("%s pattern over %lu MB, working set %lu MB, ", pattern_names[pattern],
+	       mb, pattern == PATTERN_HOT ? hot_mb : mb);
+	if (rate)
+		printf("%lu MB/s on %d vcpus\n", rate, nr_cpus);
+	else
+		printf("no rate limit on %d vcpus\n", nr_cpus);
+
+	run_on_all(prefault);
+
+	migrate_begin_background();
+	start = rdtsc();
+	cli();
+	run_on_all(dirty);
+	sti();
+	elapsed = rdtsc() - start;
+
+	printf("migration took %" PRIu64 " ms, %" PRIu64 " MB dirtied, %" PRIu64
+	       " MB/s\n", tsc_to_ns(elapsed) / 1000000,
+	       total_dirtied() * PAGE_SIZE >> 20,
+	       (total_dirtied() * PAGE_SIZE >> 20) * tsc_hz() / elapsed);
+
+	snprintf(name, sizeof(name), "dirty.%s.rate", pattern_names[pattern]);
+	stats_hist_print(name, "MB/s", &rate_hist);
+	stats_hist_record(name, "MB/s", nr_cpus, &rate_hist);
+
+	stats_hist_init(&gaps);
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		stats_hist_merge(&gaps, &dirtiers[cpu].gaps);
+	snprintf(name, sizeof(name), "dirty.%s.gap", pattern_names[pattern]);
+	tsc_hist_print(name, &gaps);
+	tsc_hist_record(name, nr_cpus, &gaps);
+
+	for (i = 0; i < nr_pages; i++)
+		if (*(u64 *)(mem + i * PAGE_SIZE) != ((u64)i << 32 | last_seq[i]))
+			errors++;
+	report(!errors, "memory contents after migration (%lu bad pages)",
+	       errors);
+
+	return report_summary();
+}
@@ -0,0 +1,206 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * First-touch guest memory fault throughput
+ *
+ * Maps a region of memory that the guest has never accessed with 4K, 2M
+ * or 1G pages and writes one word to each 4K page of it, split evenly
+ * between 1, 2, 4, ... N vCPUs.  The guest page tables are populated in
+ * advance, so all the faults are EPT/NPT violations (or shadow page
+ * faults) taken by the host; their number depends on how the host backs
+ * guest memory, e.g. one per 2M with THP or hugetlbfs.
+ *
+ * The throughput is reported in 4K pages per second, which is the fault
+ * rate if the host uses 4K pages, and in GiB/s.  Every measurement needs
+ * memory that was not touched before, so the guest needs at least
+ * (log2(N) + 1) * (2 * size + max(size, 1G)) of RAM, with size rounded up
+ * to a power of two; measurements that do not fit are skipped.
+ *
+ * Usage: first_touch.flat [size in MiB, default 128]
+ */
+#include "libcflat.h"
+#include "alloc.h"
+#include "alloc_page.h"
+#include "atomic.h"
+#include "bitops.h"
+#include "processor.h"
+#include "smp.h"
+#include "stats.h"
+#include "tsc.h"
+#include "vm.h"
+#include "vmalloc.h"
+
+static int nr_cpus;
+static size_t region_size = 128ul << 20;
+
+/* State of the current measurement, one slice of the region per vCPU. */
+static u8 *region;
+static size_t slice_size;
+static atomic_t ready;
+static volatile bool go;
+static u64 *done_tsc;
+static struct stats_hist *touch_hist;
+
+static const struct {
+	const char *name;
+	int level;
+} page_sizes[] = {
+	{ "4k", 1 },
+	{ "2m", 2 },
+	{ "1g", 3 },
+};
+
+static size_t level_size(int level)
+{
+	return 1ul << PGDIR_BITS(level);
+}
+
+/* Map fresh memory at a fresh virtual address with pages of @level. */
+static u8 *map_fresh_region(size_t size, int level)
+{
+	size_t page = level_size(level);
+	phys_addr_t phys;
+	pteval_t pte;
+	size_t off;
+	u8 *virt;
+	void *mem;
+
+	mem = memalign_pages_flags(page, size,
+				   AREA_ANY | FLAG_DONTZERO | FLAG_FRESH);
+	if (!mem)
+		return NULL;
+
+	phys = virt_to_phys(mem);
+	virt = alloc_vpages_aligned(size / PAGE_SIZE,
+				    (level - 1) * PGDIR_WIDTH);
+	for (off = 0; off < size; off += page) {
+		pte = (phys + off) | PT_PRESENT_MASK | PT_WRITABLE_MASK;
+		if (level > 1)
+			pte |= PT_PAGE_SIZE_MASK;
+		install_pte(current_page_table(), level, virt + off, pte, 0);
+	}
+	return virt;
+}
+
+static void touch(void *data)
+{
+	int cpu = (long)data;
+	struct stats_hist *hist = &touch_hist[cpu];
+	u8 *p = region + cpu * slice_size;
+	u8 *end = p + slice_size;
+	u64 start;
+
+	atomic_inc(&ready);
+	while (!go)
+		pause();
+
+	for (; p < end; p += PAGE_SIZE) {
+		start = rdtsc();
+		*(volatile u64 *)p = 1;
+		stats_hist_add(hist, rdtsc() - start);
+	}
+	done_tsc[cpu] = rdtsc();
+}
+
+static void print_rate(const char *name, int n, size_t size, u64 elapsed)
+{
+	u64 pages = size / PAGE_SIZE;
+	u64 mib_s;
+
+	if (!tsc_hz()) {
+		printf("%s cpus %d: %" PRIu64 " pages/Mcycle\n", name, n,
+		       pages * 1000000 / elapsed);
+		return;
+	}
+
+	mib_s = (size >> 20) * (tsc_hz() / 1000) / (elapsed / 1000);
+	printf("%s cpus %d: %" PRIu64 " pages/s %" PRIu64 ".%02" PRIu64
+	       " GiB/s\n", name, n,
+	       pages * (tsc_hz() / 1000) / (elapsed / 1000),
+	       mib_s / 1024, mib_s % 1024 * 100 / 1024);
+}
+
+static void measure(int idx, int n)
+{
+	static struct stats_hist total;
+	int level = page_sizes[idx].level;
+	char name[32];
+	size_t size;
+	u64 start, end;
+	int cpu;
+
+	/* The page allocator hands out power of two sizes only. */
+	size = 1ul << get_order(MAX(region_size, level_size(level)));
+	region = map_fresh_region(size, level);
+	if (!region) {
+		report_skip("%s cpus %d: not enough memory for %zu MiB",
+			    page_sizes[idx].name, n, size >> 20);
+		return;
+	}
+
+	slice_size = ALIGN_DOWN(size / n, PAGE_SIZE);
+	for (cpu = 0; cpu < n; ++cpu)
+		stats_hist_init(&touch_hist[cpu]);
+	atomic_set(&ready, 0);
+	go = false;
+
+	for (cpu = 1; cpu < n; ++cpu)
+		on_cpu_async(cpu, touch, (void *)(long)cpu);
+	while (atomic_read(&ready) < n - 1)
+		pause();
+
+	start = rdtsc();
+	go = true;
+	touch(0);
+	while (cpus_active() > 1)
+		pause();
+
+	end = 0;
+	stats_hist_init(&total);
+	for (cpu = 0; cpu < n; ++cpu) {
+		end = MAX(end, done_tsc[cpu]);
+		stats_hist_merge(&total, &touch_hist[cpu]);
+	}
+
+	snprintf(name, sizeof(name), "first_touch.%s@%d",
+		 page_sizes[idx].name, n);
+	print_rate(name, n, slice_size * n, end - start);
+	tsc_hist_print(name, &total);
+	tsc_hist_record(name, nr_cpus, &total);
+	report_pass("%s", name);
+}
+
+int main(int ac, char **av)
+{
+	int i, n;
+
+	setup_vm();
+	nr_cpus = cpu_count();
+
+	if (ac > 1)
+		region_size = (size_t)atol(av[1]) << 20;
+	if (!region_size)
+		report_abort("invalid size '%s'", av[1]);
+
+	done_tsc = calloc(nr_cpus, sizeof(*done_tsc));
+	touch_hist = calloc(nr_cpus, sizeof(*touch_hist));
+	assert(done_tsc && touch_hist);
+
+	printf("TSC frequency %" PRIu64 " kHz (%s)\n", tsc_hz() / 1000,
+	       tsc_hz_source());
+
+	for (i = 0; i < ARRAY_SIZE(page_sizes); ++i) {
+		if (page_sizes[i].level == 3 && !this_cpu_has(X86_FEATURE_GBPAGES)) {
+			report_skip("1G pages not supported");
+			continue;
+		}
+
+		for (n = 1; ; n *= 2) {
+			n = MIN(n, nr_cpus);
+			measure(i, n);
+			if (n == nr_cpus)
+				break;
+		}
+	}
+
+	return report_summary();
+}
@@ -1,6 +1,8 @@
 #include "hyperv.h"
+#include "alloc_page.h"
 #include "asm/io.h"
 #include "smp.h"
+#include "vm.h"
 
 enum {
     HV_TEST_DEV_SINT_ROUTE_CREATE = 1,
@@ -12,6 +14,52 @@ enum {
     HV_TEST_DEV_EVT_CONN_DESTROY,
 };
 
+static void *hypercall_page;
+
+void hv_setup_hypercall(void)
+{
+    u64 guestid = (0x8f00ull << 48);
+
+    hypercall_page = alloc_page();
+    if (!hypercall_page)
+        report_abort("failed to allocate hypercall page");
+
+    wrmsr(HV_X64_MSR_GUEST_OS_ID, guestid);
+
+    wrmsr(HV_X64_MSR_HYPERCALL,
+          (u64)virt_to_phys(hypercall_page) | HV_X64_MSR_HYPERCALL_ENABLE);
+}
+
+void hv_teardown_hypercall(void)
+{
+    wrmsr(HV_X64_MSR_HYPERCALL, 0);
+    wrmsr(HV_X64_MSR_GUEST_OS_ID, 0);
+    free_page(hypercall_page);
+}
+
+u64 hv_hypercall(u64 control, u64 in, u64 out)
+{
+    u64 ret;
+
+#ifdef __x86_64__
+    register u64 r8 asm("r8") = out;
+
+    asm volatile ("call *%[hcall_page]"
+                  : "=a"(ret), "+c"(control), "+d"(in), "+r"(r8)
+                  : [hcall_page] "m" (hypercall_page)
+                  : "memory");
+#else
+    asm volatile ("call *%[hcall_page]"
+                  : "=A"(ret)
+                  : "A"(control),
+                    "b" ((u32)(in >> 32)), "c" ((u32)in),
+                    "D" ((u32)(out >> 32)), "S" ((u32)out),
+                    [hcall_page] "m" (hypercall_page)
+                  : "memory");
+#endif
+    return ret;
+}
+
 static void synic_ctl(u32 ctl, u32 vcpu_id, u32 sint, u32 conn_id)
 {
     outl((conn_id << 24) | (ctl << 16) | (vcpu_id << 8) | sint, 0x3000);
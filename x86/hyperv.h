@@ -5,13 +5,20 @@
 #include "processor.h"
 
 #define HYPERV_CPUID_FEATURES                   0x40000003
+#define HYPERV_CPUID_ENLIGHTMENT_INFO           0x40000004
 
 #define HV_X64_MSR_TIME_REF_COUNT_AVAILABLE     (1 << 1)
 #define HV_X64_MSR_SYNIC_AVAILABLE              (1 << 2)
 #define HV_X64_MSR_SYNTIMER_AVAILABLE           (1 << 3)
+#define HV_X64_MSR_HYPERCALL_AVAILABLE          (1 << 5)
+#define HV_X64_MSR_VP_INDEX_AVAILABLE           (1 << 6)
+
+#define HV_X64_REMOTE_TLB_FLUSH_RECOMMENDED     (1 << 2)
+#define HV_X64_CLUSTER_IPI_RECOMMENDED          (1 << 10)
 
 #define HV_X64_MSR_GUEST_OS_ID                  0x40000000
 #define HV_X64_MSR_HYPERCALL                    0x40000001
+#define HV_X64_MSR_VP_INDEX                     0x40000002
 
 #define HV_X64_MSR_TIME_REF_COUNT               0x40000020
 #define HV_X64_MSR_REFERENCE_TSC                0x40000021
@@ -171,10 +178,31 @@ struct hv_event_flags_page {
 #define HV_X64_MSR_HYPERCALL_ENABLE             0x1
 
 #define HV_HYPERCALL_FAST               (1u << 16)
+#define HV_HYPERCALL_REP_COMP_OFFSET    32
 
+#define HVCALL_FLUSH_VIRTUAL_ADDRESS_SPACE      0x0002
+#define HVCALL_FLUSH_VIRTUAL_ADDRESS_LIST       0x0003
+#define HVCALL_SEND_IPI                         0x000b
 #define HVCALL_POST_MESSAGE                     0x5c
 #define HVCALL_SIGNAL_EVENT                     0x5d
 
+#define HV_STATUS_INVALID_HYPERCALL_CODE        2
+
+#define HV_FLUSH_ALL_VIRTUAL_ADDRESS_SPACES     (1ull << 1)
+
+struct hv_tlb_flush {
+	u64 address_space;
+	u64 flags;
+	u64 processor_mask;
+	u64 gva_list[];
+};
+
+struct hv_send_ipi {
+	u32 vector;
+	u32 reserved;
+	u64 cpu_mask;
+};
+
 struct hv_input_post_message {
 	u32 connectionid;
 	u32 reserved;
@@ -198,6 +226,20 @@ static inline bool hv_time_ref_counter_supported(void)
     return cpuid(HYPERV_CPUID_FEATURES).a & HV_X64_MSR_TIME_REF_COUNT_AVAILABLE;
 }
 
+static inline bool hv_hypercall_supported(void)
+{
+	return cpuid(HYPERV_CPUID_FEATURES).a & HV_X64_MSR_HYPERCALL_AVAILABLE;
+}
+
+/*
+ * Map the hypercall page and issue hypercalls through it.  @in and @out
+ * are the guest physical addresses of the input and output, or the input
+ * itself for fast hypercalls.
+ */
+void hv_setup_hypercall(void);
+void hv_teardown_hypercall(void);
+u64 hv_hypercall(u64 control, u64 in, u64 out);
+
 void synic_sint_create(u8 sint, u8 vec, bool auto_eoi);
 void synic_sint_set(u8 vcpu, u8 sint);
 void synic_sint_destroy(u8 sint);
@@ -0,0 +1,412 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Performance of Hyper-V enlightenments
+ *
+ * For 1, 2, 4, ... N-1 target vCPUs, vCPU0 measures:
+ *
+ * - IPIs sent with one ICR write per target, and with
+ *   HvCallSendSyntheticClusterIpi with register (fast) and memory (slow)
+ *   input; the time spent sending and the time until the last target
+ *   has acknowledged the IPI.
+ * - TLB shootdowns done with an IPI to each target followed by INVLPG in
+ *   the handler, and with HvCallFlushVirtualAddressSpace and
+ *   HvCallFlushVirtualAddressList, which KVM completes before returning.
+ *
+ * It then measures the latency of SynIC messages posted with
+ * HvCallPostMessage from vCPU0 to each other vCPU, through hyperv-testdev:
+ * the hypercall itself and the time until the target's SINT handler runs.
+ *
+ * Usage: hyperv_perf.flat [samples]
+ */
+#include "libcflat.h"
+#include "alloc_page.h"
+#include "apic.h"
+#include "atomic.h"
+#include "hyperv.h"
+#include "isr.h"
+#include "processor.h"
+#include "smp.h"
+#include "stats.h"
+#include "tsc.h"
+#include "vm.h"
+
+#define MAX_CPUS	64
+
+#define IPI_VEC		0xe0
+#define SHOOTDOWN_VEC	0xe1
+#define MSG_VEC		0xb0
+#define MSG_SINT	0x8
+#define MSG_CONN_BASE	0x10
+#define MSG_TYPE	0x12345678
+
+#define ACK_TIMEOUT	(1ull << 32)
+
+enum kind {
+	IPI_ICR,
+	IPI_HV_FAST,
+	IPI_HV_SLOW,
+	FLUSH_IPI,
+	FLUSH_HV_SPACE,
+	FLUSH_HV_LIST,
+	NR_KINDS,
+};
+
+static const struct {
+	const char *name;
+	bool acked;
+} kinds[] = {
+	[IPI_ICR] = { "ipi_icr", true },
+	[IPI_HV_FAST] = { "ipi_hv_fast", true },
+	[IPI_HV_SLOW] = { "ipi_hv_slow", true },
+	[FLUSH_IPI] = { "flush_ipi", true },
+	[FLUSH_HV_SPACE] = { "flush_hv_space", false },
+	[FLUSH_HV_LIST] = { "flush_hv_list", false },
+};
+
+static int nr_cpus;
+static unsigned long nr_samples = 1000;
+static u32 vp_index[MAX_CPUS];
+static u64 target_mask;
+static bool supported[NR_KINDS];
+
+static atomic_t acks;
+static volatile bool stop_receivers;
+static unsigned long lost, errors;
+
+/* Hypercall input pages and the page flushed by the shootdowns. */
+static struct hv_send_ipi *ipi_input;
+static struct hv_tlb_flush *flush_input;
+static struct hv_input_post_message *post_input;
+static u8 *flush_page;
+
+static struct hv_message_page *msg_pages[MAX_CPUS];
+static volatile int msg_target;
+static volatile u64 msg_recv_tsc;
+
+static void ipi_isr(isr_regs_t *regs)
+{
+	atomic_inc(&acks);
+	eoi();
+}
+
+static void shootdown_isr(isr_regs_t *regs)
+{
+	invlpg(flush_page);
+	atomic_inc(&acks);
+	eoi();
+}
+
+/* The SINT is set up with auto EOI. */
+static void msg_isr(isr_regs_t *regs)
+{
+	struct hv_message *msg = &msg_pages[msg_target]->sint_message[MSG_SINT];
+
+	msg_recv_tsc = rdtsc();
+	msg->header.message_type = HVMSG_NONE;
+	barrier();
+	if (msg->header.message_flags.msg_pending)
+		wrmsr(HV_X64_MSR_EOM, 0);
+	atomic_inc(&acks);
+}
+
+/*
+ * APs run on_cpu() functions from an interrupt handler, so interrupts
+ * have to be enabled explicitly for the duration of the measurement.
+ */
+static void receiver(void *data)
+{
+	sti();
+	while (!stop_receivers)
+		pause();
+	cli();
+}
+
+static void start_receivers(void)
+{
+	int cpu;
+
+	stop_receivers = false;
+	for (cpu = 1; cpu < nr_cpus; cpu++)
+		on_cpu_async(cpu, receiver, NULL);
+}
+
+static void stop_all_receivers(void)
+{
+	stop_receivers = true;
+	while (cpus_active() > 1)
+		pause();
+}
+
+static void read_vp_index(void *data)
+{
+	*(u32 *)data = rdmsr(HV_X64_MSR_VP_INDEX);
+}
+
+static void send_icr(int vec, int nr_targets)
+{
+	int cpu;
+
+	for (cpu = 1; cpu <= nr_targets; cpu++)
+		apic_icr_write(APIC_INT_ASSERT | APIC_DEST_PHYSICAL |
+			       APIC_DM_FIXED | vec, id_map[cpu]);
+}
+
+/* Returns the Hyper-V status of the hypercall, 0 for the ICR writes. */
+static u16 send(enum kind kind, int nr_targets)
+{
+	switch (kind) {
+	case IPI_ICR:
+		send_icr(IPI_VEC, nr_targets);
+		return 0;
+	case FLUSH_IPI:
+		send_icr(SHOOTDOWN_VEC, nr_targets);
+		return 0;
+	case IPI_HV_FAST:
+		return hv_hypercall(HVCALL_SEND_IPI | HV_HYPERCALL_FAST,
+				    IPI_VEC, target_mask);
+	case IPI_HV_SLOW:
+		ipi_input->vector = IPI_VEC;
+		ipi_input->cpu_mask = target_mask;
+		return hv_hypercall(HVCALL_SEND_IPI,
+				    virt_to_phys(ipi_input), 0);
+	case FLUSH_HV_SPACE:
+		flush_input->address_space = 0;
+		flush_input->flags = HV_FLUSH_ALL_VIRTUAL_ADDRESS_SPACES;
+		flush_input->processor_mask = target_mask;
+		return hv_hypercall(HVCALL_FLUSH_VIRTUAL_ADDRESS_SPACE,
+				    virt_to_phys(flush_input), 0);
+	case FLUSH_HV_LIST:
+		flush_input->address_space = 0;
+		flush_input->flags = HV_FLUSH_ALL_VIRTUAL_ADDRESS_SPACES;
+		flush_input->processor_mask = target_mask;
+		flush_input->gva_list[0] = (ulong)flush_page;
+		return hv_hypercall(HVCALL_FLUSH_VIRTUAL_ADDRESS_LIST |
+				    (1ull << HV_HYPERCALL_REP_COMP_OFFSET),
+				    virt_to_phys(flush_input), 0);
+	default:
+		assert(0);
+	}
+}
+
+static void print_record(const char *prefix, const char *suffix,
+			 int nr_targets, struct stats_hist *h)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "%s%s@%d", prefix, suffix, nr_targets);
+	tsc_hist_print(name, h);
+	tsc_hist_record(name, nr_cpus, h);
+}
+
+static void measure(enum kind kind, int nr_targets)
+{
+	static struct stats_hist sent_hist, done_hist;
+	u64 start, sent, end;
+	u16 status;
+	int cpu, s;
+
+	target_mask = 0;
+	for (cpu = 1; cpu <= nr_targets; cpu++)
+		target_mask |= 1ull << vp_index[cpu];
+
+	stats_hist_init(&sent_hist);
+	stats_hist_init(&done_hist);
+	for (s = 0; s < nr_samples; s++) {
+		atomic_set(&acks, 0);
+		start = rdtsc();
+		status = send(kind, nr_targets);
+		sent = rdtsc();
+
+		if (status) {
+			report_fail("%s: hypercall failed with status %#x",
+				    kinds[kind].name, status);
+			supported[kind] = false;
+			errors++;
+			return;
+		}
+
+		if (kinds[kind].acked) {
+			while (atomic_read(&acks) < nr_targets &&
+			       rdtsc() - start < ACK_TIMEOUT)
+				pause();
+			if (atomic_read(&acks) < nr_targets) {
+				lost++;
+				continue;
+			}
+		}
+		end = rdtsc();
+
+		stats_hist_add(&sent_hist, sent - start);
+		stats_hist_add(&done_hist, end - start);
+	}
+
+	if (kinds[kind].acked)
+		print_record(kinds[kind].name, "_send", nr_targets, &sent_hist);
+	print_record(kinds[kind].name, "", nr_targets, &done_hist);
+}
+
+static void setup_synic(void *data)
+{
+	int cpu = (long)data;
+
+	msg_pages[cpu] = alloc_page();
+	memset(msg_pages[cpu], 0, PAGE_SIZE);
+	wrmsr(HV_X64_MSR_SIMP,
+	      (u64)virt_to_phys(msg_pages[cpu]) | HV_SYNIC_SIMP_ENABLE);
+	wrmsr(HV_X64_MSR_SCONTROL, HV_SYNIC_CONTROL_ENABLE);
+	msg_conn_create(MSG_SINT, MSG_VEC, MSG_CONN_BASE + cpu);
+}
+
+static void teardown_synic(void *data)
+{
+	int cpu = (long)data;
+
+	msg_conn_destroy(MSG_SINT, MSG_CONN_BASE + cpu);
+	wrmsr(HV_X64_MSR_SCONTROL, 0);
+	wrmsr(HV_X64_MSR_SIMP, 0);
+	free_page(msg_pages[cpu]);
+}
+
+static void measure_messages(void)
+{
+	static struct stats_hist post, delivery;
+	unsigned long skewed = 0;
+	u64 start, sent;
+	u16 status;
+	int cpu, s;
+
+	for (cpu = 1; cpu < nr_cpus; cpu++)
+		on_cpu(cpu, setup_synic, (void *)(long)cpu);
+	start_receivers();
+
+	post_input->message_type = MSG_TYPE;
+	post_input->payload_size = 8;
+
+	stats_hist_init(&post);
+	stats_hist_init(&delivery);
+	for (s = 0; s < nr_samples; s++) {
+		msg_target = 1 + s % (nr_cpus - 1);
+		post_input->connectionid = MSG_CONN_BASE + msg_target;
+		post_input->payload[0] = s;
+		atomic_set(&acks, 0);
+
+		start = rdtsc();
+		status = hv_hypercall(HVCALL_POST_MESSAGE,
+				      virt_to_phys(post_input), 0);
+		sent = rdtsc();
+		if (status) {
+			report_fail("post message failed with status %#x",
+				    status);
+			errors++;
+			break;
+		}
+
+		while (!atomic_read(&acks) && rdtsc() - start < ACK_TIMEOUT)
+			pause();
+		if (!atomic_read(&acks)) {
+			lost++;
+			continue;
+		}
+
+		stats_hist_add(&post, sent - start);
+		/* Relies on synchronized TSCs, like ipi_latency. */
+		if (msg_recv_tsc < start)
+			skewed++;
+		else
+			stats_hist_add(&delivery, msg_recv_tsc - start);
+	}
+
+	stop_all_receivers();
+	for (cpu = 1; cpu < nr_cpus; cpu++)
+		on_cpu(cpu, teardown_synic, (void *)(long)cpu);
+
+	printf("SynIC messages to %d vCPUs\n", nr_cpus - 1);
+	if (skewed)
+		printf("%lu messages received before they were posted, dropped\n",
+		       skewed);
+	tsc_hist_print("synic_msg_post", &post);
+	tsc_hist_record("synic_msg_post", nr_cpus, &post);
+	tsc_hist_print("synic_msg_delivery", &delivery);
+	tsc_hist_record("synic_msg_delivery", nr_cpus, &delivery);
+}
+
+int main(int ac, char **av)
+{
+	u32 hints = cpuid(HYPERV_CPUID_ENLIGHTMENT_INFO).a;
+	int cpu, k, nr_targets;
+
+	if (!(cpuid(HYPERV_CPUID_FEATURES).a & HV_X64_MSR_VP_INDEX_AVAILABLE)) {
+		report_skip("Hyper-V VP index is not supported");
+		return report_summary();
+	}
+	if (!hv_hypercall_supported()) {
+		report_skip("Hyper-V hypercalls are not supported");
+		return report_summary();
+	}
+
+	setup_vm();
+	nr_cpus = cpu_count();
+	if (nr_cpus < 2) {
+		report_skip("need at least two vCPUs");
+		return report_summary();
+	}
+	if (nr_cpus > MAX_CPUS)
+		report_abort("# cpus: %d > %d", nr_cpus, MAX_CPUS);
+
+	if (ac > 1)
+		nr_samples = atol(av[1]);
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		on_cpu(cpu, read_vp_index, &vp_index[cpu]);
+		if (vp_index[cpu] >= 64)
+			report_abort("VP index %u of vCPU %d does not fit the masks",
+				     vp_index[cpu], cpu);
+	}
+
+	handle_irq(IPI_VEC, ipi_isr);
+	handle_irq(SHOOTDOWN_VEC, shootdown_isr);
+	handle_irq(MSG_VEC, msg_isr);
+	sti();
+
+	hv_setup_hypercall();
+	ipi_input = alloc_page();
+	flush_input = alloc_page();
+	post_input = alloc_page();
+	flush_page = alloc_page();
+
+	printf("TSC frequency %" PRIu64 " kHz (%s)\n", tsc_hz() / 1000,
+	       tsc_hz_source());
+
+	supported[IPI_ICR] = true;
+	supported[FLUSH_IPI] = true;
+	supported[IPI_HV_FAST] = hints & HV_X64_CLUSTER_IPI_RECOMMENDED;
+	supported[IPI_HV_SLOW] = hints & HV_X64_CLUSTER_IPI_RECOMMENDED;
+	supported[FLUSH_HV_SPACE] = hints & HV_X64_REMOTE_TLB_FLUSH_RECOMMENDED;
+	supported[FLUSH_HV_LIST] = hints & HV_X64_REMOTE_TLB_FLUSH_RECOMMENDED;
+	for (k = 0; k < NR_KINDS; k++)
+		if (!supported[k])
+			report_skip("%s: enlightenment not enabled", kinds[k].name);
+
+	start_receivers();
+	for (nr_targets = 1; ; nr_targets *= 2) {
+		nr_targets = MIN(nr_targets, nr_cpus - 1);
+		printf("%d targets\n", nr_targets);
+		for (k = 0; k < NR_KINDS; k++)
+			if (supported[k])
+				measure(k, nr_targets);
+		if (nr_targets == nr_cpus - 1)
+			break;
+	}
+	stop_all_receivers();
+
+	if (synic_supported())
+		measure_messages();
+	else
+		report_skip("Hyper-V SynIC is not supported");
+
+	hv_teardown_hypercall();
+
+	report(!lost && !errors, "all IPIs and messages delivered (%lu lost)",
+	       lost);
+	return report_summary();
+}
@@ -0,0 +1,724 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Inter-processor interrupt latency between vCPUs
+ *
+ * "matrix" sends fixed IPIs between every ordered pair of vCPUs by
+ * writing the ICR directly, bypassing on_cpu() and its lock.  The
+ * destination spins with interrupts enabled, timestamps the entry of its
+ * handler and replies with a second IPI; the source reports the one-way
+ * latency (ICR write to handler entry, which relies on synchronized TSCs)
+ * and the round-trip latency (measured on the source alone).
+ *
+ * "multicast" sends one IPI from vCPU0 to 1, 2, 4, ... N-1 targets, using
+ * a physical destination per target, a logical destination (flat model
+ * in xAPIC mode, clustered in x2APIC mode, one ICR write per cluster) and
+ * the all-excluding-self shorthand, which is measured for N-1 targets
+ * only.  If KVM supports PV IPIs, the same targets are also reached with
+ * KVM_HC_SEND_IPI hypercalls, one per 128 consecutive APIC IDs.  It
+ * reports the time spent writing the ICR (or in the hypercall) and the
+ * time until the last target has acknowledged the IPI.
+ *
+ * "hypercall" measures KVM_HC_SCHED_YIELD towards a running vCPU, and
+ * KVM_HC_KICK_CPU towards a vCPU halted with interrupts disabled, which
+ * is how PV spinlocks wait: both the cost of the hypercall and the time
+ * until the kicked vCPU is running again.
+ *
+ * "halt" lets vCPU1 sit in HLT for a controlled idle time, from 1us to
+ * 5ms, before vCPU0 wakes it up with an IPI, and reports the wakeup
+ * latency (ICR write to handler entry) for each idle time.  Short idle
+ * times are covered by halt polling in the host (halt_poll_ns) and wake
+ * up quickly; the point where the latency jumps shows where polling
+ * stops and the vCPU is scheduled out.
+ *
+ * Usage: ipi_latency.flat [matrix|multicast|hypercall|halt] [samples]
+ */
+#include "libcflat.h"
+#include "alloc.h"
+#include "apic.h"
+#include "atomic.h"
+#include "isr.h"
+#include "kvm_para.h"
+#include "processor.h"
+#include "smp.h"
+#include "stats.h"
+#include "tsc.h"
+#include "vm.h"
+
+#define REQUEST_VECTOR	0xe0
+#define REPLY_VECTOR	0xe1
+#define MULTICAST_VECTOR	0xe2
+#define HALT_VECTOR	0xe3
+
+#define IPI_TIMEOUT	(1ull << 32)
+/* Time for a kicked vCPU to get back into HLT before the next kick. */
+#define KICK_DELAY	(1ull << 16)
+
+static int nr_cpus;
+static unsigned long nr_samples = 1000;
+static volatile bool stop_receivers;
+static unsigned long lost;
+
+static struct {
+	int src;
+	int dst;
+	volatile u64 recv_tsc;
+	volatile bool replied;
+	volatile bool done;
+	unsigned long skewed;
+	struct stats_hist oneway;
+	struct stats_hist roundtrip;
+} pair;
+
+static void request_isr(isr_regs_t *regs)
+{
+	pair.recv_tsc = rdtsc();
+	eoi();
+	apic_icr_write(APIC_INT_ASSERT | APIC_DEST_PHYSICAL | APIC_DM_FIXED |
+		       REPLY_VECTOR, id_map[pair.src]);
+}
+
+static void reply_isr(isr_regs_t *regs)
+{
+	pair.replied = true;
+	eoi();
+}
+
+/*
+ * APs run on_cpu() functions from an interrupt handler, so interrupts
+ * have to be enabled explicitly for the duration of the measurement.
+ */
+static void receiver(void *data)
+{
+	sti();
+	while (!stop_receivers)
+		pause();
+	cli();
+}
+
+static void sender(void)
+{
+	u64 start, end;
+	int i;
+
+	for (i = 0; i < nr_samples; i++) {
+		pair.replied = false;
+		start = rdtsc();
+		apic_icr_write(APIC_INT_ASSERT | APIC_DEST_PHYSICAL |
+			       APIC_DM_FIXED | REQUEST_VECTOR,
+			       id_map[pair.dst]);
+		while (!pair.replied && rdtsc() - start < IPI_TIMEOUT)
+			pause();
+		end = rdtsc();
+
+		if (!pair.replied) {
+			lost++;
+			continue;
+		}
+
+		/* Received before sent: the TSCs differ, drop the sample. */
+		if (pair.recv_tsc < start)
+			pair.skewed++;
+		else
+			stats_hist_add(&pair.oneway, pair.recv_tsc - start);
+		stats_hist_add(&pair.roundtrip, end - start);
+	}
+	pair.done = true;
+}
+
+static void remote_sender(void *data)
+{
+	sti();
+	sender();
+	cli();
+}
+
+static void measure_pair(int src, int dst)
+{
+	pair.src = src;
+	pair.dst = dst;
+	pair.done = false;
+	pair.skewed = 0;
+	stop_receivers = false;
+	stats_hist_init(&pair.oneway);
+	stats_hist_init(&pair.roundtrip);
+
+	/* The BSP has interrupts enabled while it waits for the sender. */
+	if (dst)
+		on_cpu_async(dst, receiver, NULL);
+	if (src)
+		on_cpu_async(src, remote_sender, NULL);
+	else
+		sender();
+
+	while (!pair.done)
+		pause();
+
+	stop_receivers = true;
+	while (cpus_active() > 1)
+		pause();
+}
+
+static void print_matrix(const char *title, u64 *m)
+{
+	int src, dst;
+
+	printf("%s (cycles), rows: source, columns: destination\n", title);
+	printf("%5s", "");
+	for (dst = 0; dst < nr_cpus; dst++)
+		printf(" %7d", dst);
+	printf("\n");
+
+	for (src = 0; src < nr_cpus; src++) {
+		printf("%5d", src);
+		for (dst = 0; dst < nr_cpus; dst++) {
+			if (src == dst)
+				printf(" %7s", "-");
+			else
+				printf(" %7" PRIu64, m[src * nr_cpus + dst]);
+		}
+		printf("\n");
+	}
+}
+
+static void ipi_matrix(void)
+{
+	u64 *oneway_p50, *oneway_p99, *roundtrip_p50, *roundtrip_p99;
+	u64 worst = 0;
+	unsigned long skewed = 0;
+	int worst_src = 0, worst_dst = 0;
+	char name[64];
+	int src, dst, idx;
+
+	if (nr_cpus < 2) {
+		report_skip("ipi matrix needs at least two vCPUs");
+		return;
+	}
+
+	oneway_p50 = calloc(nr_cpus * nr_cpus, sizeof(u64));
+	oneway_p99 = calloc(nr_cpus * nr_cpus, sizeof(u64));
+	roundtrip_p50 = calloc(nr_cpus * nr_cpus, sizeof(u64));
+	roundtrip_p99 = calloc(nr_cpus * nr_cpus, sizeof(u64));
+	assert(oneway_p50 && oneway_p99 && roundtrip_p50 && roundtrip_p99);
+
+	printf("ipi matrix: %d vCPUs, %lu samples per pair\n",
+	       nr_cpus, nr_samples);
+
+	for (src = 0; src < nr_cpus; src++) {
+		for (dst = 0; dst < nr_cpus; dst++) {
+			if (src == dst)
+				continue;
+
+			measure_pair(src, dst);
+			if (pair.skewed)
+				printf("%d -> %d: %lu one-way samples skewed\n",
+				       src, dst, pair.skewed);
+			skewed += pair.skewed;
+
+			idx = src * nr_cpus + dst;
+			oneway_p50[idx] = stats_hist_percentile(&pair.oneway, 500);
+			oneway_p99[idx] = stats_hist_percentile(&pair.oneway, 990);
+			roundtrip_p50[idx] = stats_hist_percentile(&pair.roundtrip, 500);
+			roundtrip_p99[idx] = stats_hist_percentile(&pair.roundtrip, 990);
+			if (roundtrip_p50[idx] > worst) {
+				worst = roundtrip_p50[idx];
+				worst_src = src;
+				worst_dst = dst;
+			}
+
+			snprintf(name, sizeof(name), "ipi_oneway.%d-%d", src, dst);
+			tsc_hist_record(name, nr_cpus, &pair.oneway);
+			snprintf(name, sizeof(name), "ipi_roundtrip.%d-%d", src, dst);
+			tsc_hist_record(name, nr_cpus, &pair.roundtrip);
+		}
+	}
+
+	print_matrix("one-way p50", oneway_p50);
+	print_matrix("one-way p99", oneway_p99);
+	print_matrix("round-trip p50", roundtrip_p50);
+	print_matrix("round-trip p99", roundtrip_p99);
+	printf("slowest pair: %d -> %d, round-trip p50 %" PRIu64 " cycles\n",
+	       worst_src, worst_dst, worst);
+
+	if (skewed)
+		report_info("%lu one-way samples arrived before they were sent, TSCs are not synchronized",
+			    skewed);
+	report(!lost, "all IPIs delivered (%lu lost)", lost);
+
+	free(oneway_p50);
+	free(oneway_p99);
+	free(roundtrip_p50);
+	free(roundtrip_p99);
+}
+
+enum multicast_kind {
+	IPI_PHYSICAL,
+	IPI_LOGICAL,
+	IPI_SHORTHAND,
+	IPI_PV,
+};
+
+static const char *multicast_names[] = {
+	[IPI_PHYSICAL] = "physical",
+	[IPI_LOGICAL] = "logical",
+	[IPI_SHORTHAND] = "shorthand",
+	[IPI_PV] = "pv",
+};
+
+/* Arguments of KVM_HC_SEND_IPI, a bitmap of 128 APIC IDs from @min. */
+struct pv_dest {
+	unsigned long bitmap[2];
+	u32 min;
+};
+
+static atomic_t acks;
+static u32 logical_ids[MAX_TEST_CPUS];
+static u32 dests[MAX_TEST_CPUS];
+static struct pv_dest pv_dests[MAX_TEST_CPUS];
+static bool x2apic_mode;
+
+static void multicast_isr(isr_regs_t *regs)
+{
+	atomic_inc(&acks);
+	eoi();
+}
+
+static void set_flat_ldr(void *data)
+{
+	apic_write(APIC_DFR, APIC_DFR_FLAT);
+	apic_write(APIC_LDR, (unsigned long)data << 24);
+}
+
+static void read_ldr(void *data)
+{
+	*(u32 *)data = apic_read(APIC_LDR);
+}
+
+/*
+ * Fill in dests[] for targets 1..@nr_targets, and return the number of
+ * ICR writes needed to reach all of them.
+ */
+static int build_dests(enum multicast_kind kind, int nr_targets)
+{
+	int cpu, i, nr_dests = 0;
+	u32 id;
+
+	switch (kind) {
+	case IPI_PHYSICAL:
+		for (cpu = 1; cpu <= nr_targets; cpu++)
+			dests[nr_dests++] = id_map[cpu];
+		break;
+	case IPI_LOGICAL:
+		if (!x2apic_mode) {
+			dests[0] = 0;
+			for (cpu = 1; cpu <= nr_targets; cpu++)
+				dests[0] |= logical_ids[cpu] >> 24;
+			nr_dests = 1;
+			break;
+		}
+
+		/* One write per cluster, ORing in the IDs within the cluster. */
+		for (cpu = 1; cpu <= nr_targets; cpu++) {
+			id = logical_ids[cpu];
+			for (i = 0; i < nr_dests; i++)
+				if ((dests[i] >> 16) == (id >> 16))
+					break;
+			if (i == nr_dests)
+				dests[nr_dests++] = id;
+			else
+				dests[i] |= id;
+		}
+		break;
+	case IPI_SHORTHAND:
+		dests[nr_dests++] = 0;
+		break;
+	case IPI_PV:
+		for (cpu = 1; cpu <= nr_targets; cpu++) {
+			id = id_map[cpu];
+			for (i = 0; i < nr_dests; i++)
+				if (id >= pv_dests[i].min &&
+				    id - pv_dests[i].min < 128)
+					break;
+			if (i == nr_dests) {
+				memset(&pv_dests[i], 0, sizeof(pv_dests[i]));
+				pv_dests[i].min = id;
+				nr_dests++;
+			}
+			id -= pv_dests[i].min;
+			pv_dests[i].bitmap[id / 64] |= 1ul << (id % 64);
+		}
+		break;
+	}
+	return nr_dests;
+}
+
+static void measure_multicast(enum multicast_kind kind, int nr_targets)
+{
+	static const u32 icr_flags[] = {
+		[IPI_PHYSICAL] = APIC_DEST_PHYSICAL,
+		[IPI_LOGICAL] = APIC_DEST_LOGICAL,
+		[IPI_SHORTHAND] = APIC_DEST_PHYSICAL | APIC_DEST_ALLBUT,
+		[IPI_PV] = 0,
+	};
+	static struct stats_hist send, last_ack;
+	u32 icr = APIC_INT_ASSERT | APIC_DM_FIXED | MULTICAST_VECTOR |
+		  icr_flags[kind];
+	u64 start, sent, end;
+	int i, nr_dests;
+	char name[64];
+	int s;
+
+	nr_dests = build_dests(kind, nr_targets);
+	stats_hist_init(&send);
+	stats_hist_init(&last_ack);
+
+	for (s = 0; s < nr_samples; s++) {
+		atomic_set(&acks, 0);
+		start = rdtsc();
+		for (i = 0; i < nr_dests; i++) {
+			if (kind == IPI_PV)
+				kvm_hypercall(KVM_HC_SEND_IPI,
+					      pv_dests[i].bitmap[0],
+					      pv_dests[i].bitmap[1],
+					      pv_dests[i].min, icr);
+			else
+				apic_icr_write(icr, dests[i]);
+		}
+		sent = rdtsc();
+		while (atomic_read(&acks) < nr_targets &&
+		       rdtsc() - start < IPI_TIMEOUT)
+			pause();
+		end = rdtsc();
+
+		if (atomic_read(&acks) < nr_targets) {
+			lost++;
+			continue;
+		}
+		stats_hist_add(&send, sent - start);
+		stats_hist_add(&last_ack, end - start);
+	}
+
+	printf("%s, %d targets, %d %s\n", multicast_names[kind],
+	       nr_targets, nr_dests, kind == IPI_PV ? "hypercalls" : "ICR writes");
+	tsc_hist_print("  send", &send);
+	tsc_hist_print("  last ack", &last_ack);
+
+	snprintf(name, sizeof(name), "ipi_%s_send@%d",
+		 multicast_names[kind], nr_targets);
+	tsc_hist_record(name, nr_cpus, &send);
+	snprintf(name, sizeof(name), "ipi_%s_ack@%d",
+		 multicast_names[kind], nr_targets);
+	tsc_hist_record(name, nr_cpus, &last_ack);
+}
+
+static void ipi_multicast(void)
+{
+	bool pv_ipi = kvm_para_has_feature(KVM_FEATURE_PV_SEND_IPI);
+	int cpu, nr_targets, max_logical;
+
+	if (nr_cpus < 2) {
+		report_skip("multicast IPIs need at least two vCPUs");
+		return;
+	}
+
+	x2apic_mode = rdmsr(MSR_IA32_APICBASE) & APIC_EXTD;
+
+	/*
+	 * The flat model has one bit per vCPU in an 8-bit logical ID, in
+	 * x2APIC mode the logical IDs are read-only and derived from the
+	 * APIC ID.
+	 */
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		if (!x2apic_mode)
+			on_cpu(cpu, set_flat_ldr,
+			       (void *)(cpu < 8 ? BIT(cpu) : 0ul));
+		on_cpu(cpu, read_ldr, &logical_ids[cpu]);
+	}
+	max_logical = x2apic_mode ? nr_cpus - 1 : MIN(nr_cpus - 1, 7);
+
+	printf("multicast: %d vCPUs, %s mode, %lu samples\n", nr_cpus,
+	       x2apic_mode ? "x2APIC" : "xAPIC", nr_samples);
+
+	stop_receivers = false;
+	for (cpu = 1; cpu < nr_cpus; cpu++)
+		on_cpu_async(cpu, receiver, NULL);
+
+	for (nr_targets = 1; ; nr_targets *= 2) {
+		nr_targets = MIN(nr_targets, nr_cpus - 1);
+
+		measure_multicast(IPI_PHYSICAL, nr_targets);
+		if (nr_targets <= max_logical)
+			measure_multicast(IPI_LOGICAL, nr_targets);
+		if (pv_ipi)
+			measure_multicast(IPI_PV, nr_targets);
+
+		if (nr_targets == nr_cpus - 1)
+			break;
+	}
+	measure_multicast(IPI_SHORTHAND, nr_cpus - 1);
+
+	stop_receivers = true;
+	while (cpus_active() > 1)
+		pause();
+
+	if (max_logical < nr_cpus - 1)
+		report_info("flat logical mode covers only %d targets", max_logical);
+	if (!pv_ipi)
+		report_info("PV IPIs not supported");
+	report(!lost, "all IPIs delivered (%lu lost)", lost);
+}
+
+/*
+ * Wait for kicks the way PV spinlocks do, halted with interrupts disabled
+ * (on_cpu() functions already run with interrupts disabled).  Only
+ * KVM_HC_KICK_CPU can wake the vCPU up.
+ */
+static void kick_receiver(void *data)
+{
+	while (!stop_receivers) {
+		asm volatile ("hlt");
+		atomic_inc(&acks);
+	}
+}
+
+static void report_hypercall(const char *name, struct stats_hist *h)
+{
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), "  %s", name);
+	tsc_hist_print(buf, h);
+	tsc_hist_record(name, nr_cpus, h);
+}
+
+static void measure_sched_yield(void)
+{
+	static struct stats_hist yield;
+	u64 start;
+	int cpu, s;
+
+	stop_receivers = false;
+	for (cpu = 1; cpu < nr_cpus; cpu++)
+		on_cpu_async(cpu, receiver, NULL);
+
+	stats_hist_init(&yield);
+	for (s = 0; s < nr_samples; s++) {
+		cpu = 1 + s % (nr_cpus - 1);
+		start = rdtsc();
+		kvm_hypercall(KVM_HC_SCHED_YIELD, id_map[cpu], 0, 0, 0);
+		stats_hist_add(&yield, rdtsc() - start);
+	}
+
+	stop_receivers = true;
+	while (cpus_active() > 1)
+		pause();
+
+	printf("sched_yield to a running vCPU\n");
+	report_hypercall("hc_sched_yield", &yield);
+}
+
+static void measure_kick_cpu(void)
+{
+	static struct stats_hist kick, wake;
+	u64 start, sent, end;
+	int cpu, s, before;
+
+	stop_receivers = false;
+	for (cpu = 1; cpu < nr_cpus; cpu++)
+		on_cpu_async(cpu, kick_receiver, NULL);
+
+	stats_hist_init(&kick);
+	stats_hist_init(&wake);
+	for (s = 0; s < nr_samples; s++) {
+		cpu = 1 + s % (nr_cpus - 1);
+
+		start = rdtsc();
+		while (rdtsc() - start < KICK_DELAY)
+			pause();
+
+		before = atomic_read(&acks);
+		start = rdtsc();
+		kvm_hypercall(KVM_HC_KICK_CPU, 0, id_map[cpu], 0, 0);
+		sent = rdtsc();
+		while (atomic_read(&acks) == before &&
+		       rdtsc() - start < IPI_TIMEOUT)
+			pause();
+		end = rdtsc();
+
+		if (atomic_read(&acks) == before) {
+			lost++;
+			continue;
+		}
+		stats_hist_add(&kick, sent - start);
+		stats_hist_add(&wake, end - start);
+	}
+
+	stop_receivers = true;
+	for (cpu = 1; cpu < nr_cpus; cpu++)
+		kvm_hypercall(KVM_HC_KICK_CPU, 0, id_map[cpu], 0, 0);
+	while (cpus_active() > 1)
+		pause();
+
+	printf("kick_cpu to a halted vCPU\n");
+	report_hypercall("hc_kick_cpu", &kick);
+	report_hypercall("hc_kick_cpu_wake", &wake);
+}
+
+static void pv_hypercalls(void)
+{
+	if (nr_cpus < 2) {
+		report_skip("PV hypercalls need at least two vCPUs");
+		return;
+	}
+
+	printf("hypercall: %d vCPUs, %lu samples\n", nr_cpus, nr_samples);
+
+	if (kvm_para_has_feature(KVM_FEATURE_PV_SCHED_YIELD))
+		measure_sched_yield();
+	else
+		report_skip("KVM_HC_SCHED_YIELD not supported");
+
+	if (kvm_para_has_feature(KVM_FEATURE_PV_UNHALT)) {
+		measure_kick_cpu();
+		report(!lost, "all kicks delivered (%lu lost)", lost);
+	} else {
+		report_skip("KVM_HC_KICK_CPU not supported");
+	}
+}
+
+static const u64 idle_us[] = {
+	1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000,
+};
+
+static struct {
+	volatile bool halting;
+	volatile bool woken;
+	volatile u64 recv_tsc;
+} halt;
+
+static void halt_isr(isr_regs_t *regs)
+{
+	halt.recv_tsc = rdtsc();
+	halt.woken = true;
+	eoi();
+}
+
+/*
+ * Announce the halt with interrupts disabled, so that the wakeup IPI can
+ * only be taken once the vCPU is in HLT (STI blocks interrupts until
+ * after the next instruction).
+ */
+static void halt_receiver(void *data)
+{
+	while (!stop_receivers) {
+		cli();
+		halt.halting = true;
+		safe_halt();
+	}
+	cli();
+}
+
+static void measure_halt(u64 us)
+{
+	static struct stats_hist wake;
+	u64 idle = us * (tsc_hz() / 1000) / 1000;
+	unsigned long skewed = 0;
+	u64 start;
+	char name[64];
+	int s;
+
+	stats_hist_init(&wake);
+	for (s = 0; s < nr_samples; s++) {
+		while (!halt.halting)
+			pause();
+		halt.halting = false;
+		halt.woken = false;
+
+		start = rdtsc();
+		while (rdtsc() - start < idle)
+			pause();
+
+		start = rdtsc();
+		apic_icr_write(APIC_INT_ASSERT | APIC_DEST_PHYSICAL |
+			       APIC_DM_FIXED | HALT_VECTOR, id_map[1]);
+		while (!halt.woken && rdtsc() - start < IPI_TIMEOUT)
+			pause();
+		if (!halt.woken) {
+			lost++;
+			break;
+		}
+
+		if (halt.recv_tsc < start)
+			skewed++;
+		else
+			stats_hist_add(&wake, halt.recv_tsc - start);
+	}
+
+	snprintf(name, sizeof(name), "halt_wakeup.%" PRIu64 "us", us);
+	if (skewed)
+		printf("%s: %lu samples woke before the IPI was sent, dropped\n",
+		       name, skewed);
+	tsc_hist_print(name, &wake);
+	tsc_hist_record(name, nr_cpus, &wake);
+}
+
+static void halt_wakeup(void)
+{
+	int i;
+
+	if (nr_cpus < 2) {
+		report_skip("halt wakeup needs at least two vCPUs");
+		return;
+	}
+	if (!tsc_hz()) {
+		report_skip("halt wakeup needs the TSC frequency");
+		return;
+	}
+
+	printf("halt: %lu samples per idle time, TSC frequency %" PRIu64
+	       " kHz (%s)\n", nr_samples, tsc_hz() / 1000, tsc_hz_source());
+
+	stop_receivers = false;
+	halt.halting = false;
+	on_cpu_async(1, halt_receiver, NULL);
+
+	/* A lost wakeup leaves the receiver halted, so stop there. */
+	for (i = 0; i < ARRAY_SIZE(idle_us) && !lost; i++)
+		measure_halt(idle_us[i]);
+
+	stop_receivers = true;
+	apic_icr_write(APIC_INT_ASSERT | APIC_DEST_PHYSICAL | APIC_DM_FIXED |
+		       HALT_VECTOR, id_map[1]);
+	while (cpus_active() > 1)
+		pause();
+
+	report(!lost, "all wakeups delivered (%lu lost)", lost);
+}
+
+int main(int ac, char **av)
+{
+	const char *mode = ac > 1 ? av[1] : "matrix";
+
+	setup_vm();
+	nr_cpus = cpu_count();
+
+	if (ac > 2)
+		nr_samples = atol(av[2]);
+
+	handle_irq(REQUEST_VECTOR, request_isr);
+	handle_irq(REPLY_VECTOR, reply_isr);
+	handle_irq(MULTICAST_VECTOR, multicast_isr);
+	handle_irq(HALT_VECTOR, halt_isr);
+	sti();
+
+	if (!strcmp(mode, "matrix"))
+		ipi_matrix();
+	else if (!strcmp(mode, "multicast"))
+		ipi_multicast();
+	else if (!strcmp(mode, "hypercall"))
+		pv_hypercalls();
+	else if (!strcmp(mode, "halt"))
+		halt_wakeup();
+	else
+		report_abort("unknown mode '%s'", mode);
+
+	return report_summary();
+}
@@ -3,6 +3,8 @@
 #include "atomic.h"
 #include "processor.h"
 #include "kvmclock.h"
+#include "stats.h"
+#include "tsc.h"
 
 #define DEFAULT_TEST_LOOPS 100000000L
 #define DEFAULT_THRESHOLD  5L
@@ -22,6 +24,36 @@ struct test_info {
 
 struct test_info ti[4];
 
+/*
+ * Lock-free mode: every vCPU reads kvmclock in batches to measure the cost
+ * of a read, publishes the last value it read and, after each batch,
+ * compares a fresh read against the value published by the next vCPU in
+ * turn.  The peer's value was read before ours, so a smaller result is a
+ * warp.  Clock reads use the raw cycles, without the global monotonic
+ * fixup, so that host-side drift (TSC scaling, migration) is visible.
+ */
+#define LOCKFREE_DEFAULT_SECS   10
+#define READ_BATCH              64
+
+struct lockfree_cpu {
+        atomic64_t published;           /* last kvmclock value read */
+        u64 last;                       /* private copy of published */
+        u64 start, end;                 /* kvmclock at start and end */
+        unsigned long reads;
+        unsigned long checks;
+        unsigned long warps;
+        struct stats_hist read_cost;    /* cycles per read */
+        struct stats_hist warp;         /* warp magnitudes in ns */
+} __attribute__((aligned(64)));
+
+/* Indexed by CPU index, i.e. the position in id_map[], not the APIC ID. */
+static struct lockfree_cpu lf[MAX_CPU];
+static u64 worst_warp[MAX_CPU][MAX_CPU];        /* [reader][peer], ns */
+static u64 lf_deadline;
+static u64 lf_interval = NSEC_PER_SEC;
+static atomic_t lf_ready;
+static volatile bool lf_go;
+
 static void wallclock_test(void *data)
 {
         int *p_err = data;
@@ -79,6 +111,164 @@ static void kvm_clock_test(void *data)
         }
 }
 
+static void lockfree_publish(struct lockfree_cpu *c, u64 val)
+{
+        /* Plain 64-bit stores are not atomic on i386. */
+        atomic64_cmpxchg(&c->published, c->last, val);
+        c->last = val;
+}
+
+/*
+ * Printed by vCPU 0 every interval: the total warps so far and how far
+ * kvmclock has moved from the TSC, at the frequency calibrated at start,
+ * since the beginning of the run.
+ */
+static void lockfree_progress(int ncpus, u64 now, u64 tsc_start)
+{
+        unsigned long warps = 0;
+        s64 drift;
+        int i;
+
+        for (i = 0; i < ncpus; i++)
+                warps += lf[i].warps;
+
+        printf("%" PRIu64 " s: %lu warps",
+               (u64)((now - lf[0].start) / NSEC_PER_SEC), warps);
+        if (tsc_hz()) {
+                drift = (s64)(now - lf[0].start) -
+                        (s64)tsc_to_ns(rdtsc() - tsc_start);
+                printf(", kvmclock - TSC %" PRId64 " ns", drift);
+        }
+        printf("\n");
+}
+
+static void lockfree_test(void *data)
+{
+        int ncpus = cpu_count();
+        int me = (long)data;
+        struct lockfree_cpu *c = &lf[me];
+        u64 now, prev, start, tsc_start, next_report;
+        int peer = me;
+        int i;
+
+        atomic_inc(&lf_ready);
+        while (!lf_go)
+                pause();
+
+        tsc_start = rdtsc();
+        c->start = kvm_clock_read();
+        next_report = c->start + lf_interval;
+        lockfree_publish(c, c->start);
+
+        do {
+                start = rdtsc();
+                for (i = 0; i < READ_BATCH; i++)
+                        now = kvm_clock_read();
+                stats_hist_add(&c->read_cost, (rdtsc() - start) / READ_BATCH);
+                c->reads += READ_BATCH;
+                lockfree_publish(c, now);
+
+                if (ncpus > 1) {
+                        peer = (peer + 1) % ncpus;
+                        if (peer == me)
+                                peer = (peer + 1) % ncpus;
+
+                        prev = atomic64_read(&lf[peer].published);
+                        now = kvm_clock_read();
+                        lockfree_publish(c, now);
+                        c->checks++;
+                        if (prev > now) {
+                                c->warps++;
+                                stats_hist_add(&c->warp, prev - now);
+                                if (prev - now > worst_warp[me][peer])
+                                        worst_warp[me][peer] = prev - now;
+                        }
+                }
+
+                if (me == 0 && now >= next_report) {
+                        lockfree_progress(ncpus, now, tsc_start);
+                        next_report += lf_interval;
+                }
+        } while (now < lf_deadline);
+
+        c->end = now;
+}
+
+/* Usage: kvmclock_test.flat lockfree [seconds] [report interval in s] */
+static int lockfree_main(int ac, char **av)
+{
+        static struct stats_hist read_cost, warp;
+        int ncpus = cpu_count();
+        unsigned long warps = 0, checks = 0;
+        long secs = LOCKFREE_DEFAULT_SECS;
+        u64 rate, ms;
+        int i, j;
+
+        if (ac > 1)
+                secs = atol(av[1]);
+        if (ac > 2)
+                lf_interval = atol(av[2]) * NSEC_PER_SEC;
+        if (secs <= 0 || !lf_interval)
+                report_abort("invalid duration or interval");
+
+        printf("TSC frequency %" PRIu64 " kHz (%s)\n", tsc_hz() / 1000,
+               tsc_hz_source());
+        printf("Lock-free read and warp test, %ld s on %d vcpus\n", secs,
+               ncpus);
+
+        pvclock_set_flags(PVCLOCK_TSC_STABLE_BIT | PVCLOCK_RAW_CYCLE_BIT);
+        for (i = 0; i < ncpus; i++) {
+                stats_hist_init(&lf[i].read_cost);
+                stats_hist_init(&lf[i].warp);
+        }
+
+        lf_deadline = kvm_clock_read() + secs * NSEC_PER_SEC;
+        for (i = 1; i < ncpus; i++)
+                on_cpu_async(i, lockfree_test, (void *)(long)i);
+        while (atomic_read(&lf_ready) < ncpus - 1)
+                pause();
+        lf_go = true;
+        lockfree_test((void *)0);
+        while (cpus_active() > 1)
+                pause();
+
+        stats_hist_init(&read_cost);
+        stats_hist_init(&warp);
+        for (i = 0; i < ncpus; i++) {
+                struct lockfree_cpu *c = &lf[i];
+
+                /* Split the division, reads * NSEC_PER_SEC overflows. */
+                ms = (c->end - c->start) / 1000000;
+                rate = ms ? (u64)c->reads / ms * 1000 +
+                            (u64)c->reads % ms * 1000 / ms : 0;
+                printf("vcpu %d: %lu reads, %" PRIu64 " reads/s, "
+                       "%lu warps in %lu checks\n",
+                       i, c->reads, rate, c->warps, c->checks);
+                stats_hist_merge(&read_cost, &c->read_cost);
+                stats_hist_merge(&warp, &c->warp);
+                warps += c->warps;
+                checks += c->checks;
+        }
+
+        tsc_hist_print("kvmclock.read", &read_cost);
+        tsc_hist_record("kvmclock.read", ncpus, &read_cost);
+        stats_hist_print("kvmclock.warp", "ns", &warp);
+        stats_hist_record("kvmclock.warp", "ns", ncpus, &warp);
+
+        if (warps) {
+                printf("Worst warp in ns, reader vcpu by row, peer by column:\n");
+                for (i = 0; i < ncpus; i++) {
+                        for (j = 0; j < ncpus; j++)
+                                printf(" %8" PRIu64, worst_warp[i][j]);
+                        printf("\n");
+                }
+        }
+
+        report(!warps, "no warps in %lu cross-vcpu checks (%lu warps)",
+               checks, warps);
+        return report_summary();
+}
+
 static int cycle_test(int check, struct test_info *ti)
 {
         unsigned long long begin, end;
@@ -108,6 +298,17 @@ int main(int ac, char **av)
         int ncpus;
         int i;
 
+        ncpus = cpu_count();
+        if (ncpus > MAX_CPU)
+                report_abort("number cpus exceeds %d", MAX_CPU);
+
+        if (ac > 1 && !strcmp(av[1], "lockfree")) {
+                on_cpus(kvm_clock_init, NULL);
+                nerr = lockfree_main(ac - 1, av + 1);
+                on_cpus(kvm_clock_clear, NULL);
+                return nerr;
+        }
+
         if (ac > 1)
                 loops = atol(av[1]);
         if (ac > 2)
@@ -115,10 +316,6 @@ int main(int ac, char **av)
         if (ac > 3)
                 threshold = atol(av[3]);
 
-        ncpus = cpu_count();
-        if (ncpus > MAX_CPU)
-                report_abort("number cpus exceeds %d", MAX_CPU);
-
         on_cpus(kvm_clock_init, NULL);
 
         if (ac > 2) {
@@ -0,0 +1,329 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Spinlock contention across vCPUs
+ *
+ * 1, 2, 4, ... N vCPUs repeatedly take one shared lock, hold it for a
+ * critical section of a given number of cycles and then wait for a given
+ * number of cycles before taking it again.  The lock algorithms are:
+ *
+ * - tas:    test-and-test-and-set with PAUSE
+ * - ticket: FIFO ticket lock
+ * - mcs:    queued (MCS) lock, each waiter spins on its own node
+ * - mcs_pv: MCS lock whose waiters halt after spinning for a while and
+ *           are kicked with KVM_HC_KICK_CPU by the unlocker, like Linux
+ *           PV spinlocks (needs KVM_FEATURE_PV_UNHALT)
+ *
+ * The benchmark reports acquisitions per second and a histogram of the
+ * time spent waiting for the lock, whose maximum is the worst-case wait.
+ * Lock holder preemption only happens when the vCPUs are overcommitted on
+ * the host, e.g. with more vCPUs than host CPUs available to QEMU; the
+ * host PAUSE-loop exiting window (ple_gap/ple_window) then decides how
+ * quickly spinning waiters yield to the preempted holder.
+ *
+ * Usage: lock_contention.flat [critical section cycles, default 1000]
+ *                             [cycles between acquisitions, default 1000]
+ *                             [ms per measurement, default 500]
+ */
+#include "libcflat.h"
+#include "alloc.h"
+#include "apic.h"
+#include "atomic.h"
+#include "kvm_para.h"
+#include "processor.h"
+#include "smp.h"
+#include "stats.h"
+#include "tsc.h"
+#include "asm/barrier.h"
+
+/* Spins before a mcs_pv waiter halts, as in Linux's SPIN_THRESHOLD. */
+#define PV_SPIN_THRESHOLD	(1 << 15)
+
+struct mcs_node {
+	struct mcs_node *volatile next;
+	volatile int locked;
+	volatile int halted;
+	u32 apic_id;
+};
+
+struct worker {
+	struct mcs_node node;
+	unsigned long acquisitions;
+	unsigned long kicks;
+	struct stats_hist wait;
+} __attribute__((aligned(64)));
+
+struct lock_algo {
+	const char *name;
+	bool (*supported)(void);
+	void (*lock)(struct worker *w);
+	void (*unlock)(struct worker *w);
+};
+
+static int nr_cpus;
+static u64 cs_cycles = 1000;
+static u64 idle_cycles = 1000;
+static u64 run_cycles;
+
+static struct worker *workers;
+static atomic_t ready;
+static volatile bool go;
+static volatile u64 run_end;
+static unsigned long shared_counter;
+
+static volatile int tas_lock_word;
+static volatile u32 ticket_next, ticket_owner;
+static struct mcs_node *volatile mcs_tail;
+
+static void delay_cycles(u64 cycles)
+{
+	u64 start = rdtsc();
+
+	while (rdtsc() - start < cycles)
+		;
+}
+
+static bool always(void)
+{
+	return true;
+}
+
+static void tas_lock(struct worker *w)
+{
+	for (;;) {
+		while (tas_lock_word)
+			pause();
+		if (!__sync_lock_test_and_set(&tas_lock_word, 1))
+			return;
+	}
+}
+
+static void tas_unlock(struct worker *w)
+{
+	__sync_lock_release(&tas_lock_word);
+}
+
+static void ticket_lock(struct worker *w)
+{
+	u32 ticket = __sync_fetch_and_add(&ticket_next, 1);
+
+	while (ticket_owner != ticket)
+		pause();
+}
+
+static void ticket_unlock(struct worker *w)
+{
+	barrier();
+	ticket_owner = ticket_owner + 1;
+}
+
+static void __mcs_lock(struct worker *w, bool pv)
+{
+	struct mcs_node *node = &w->node, *prev;
+	int i;
+
+	node->next = NULL;
+	node->locked = 0;
+	node->halted = 0;
+
+	prev = __sync_lock_test_and_set(&mcs_tail, node);
+	if (!prev)
+		return;
+	prev->next = node;
+
+	for (i = 0; !pv || i < PV_SPIN_THRESHOLD; i++) {
+		if (node->locked)
+			return;
+		pause();
+	}
+
+	/*
+	 * Interrupts are disabled (on_cpu() functions run from an interrupt
+	 * handler on APs and the BSP disables them), so only a kick can end
+	 * the HLT.  Either the unlocker sees halted set and kicks, or we see
+	 * locked set; a kick that arrives before the HLT makes it a nop.
+	 */
+	while (!node->locked) {
+		node->halted = 1;
+		mb();
+		if (!node->locked)
+			asm volatile("hlt");
+		node->halted = 0;
+	}
+}
+
+static void __mcs_unlock(struct worker *w, bool pv)
+{
+	struct mcs_node *node = &w->node, *next = node->next;
+
+	if (!next) {
+		if (__sync_val_compare_and_swap(&mcs_tail, node, NULL) == node)
+			return;
+		while (!(next = node->next))
+			pause();
+	}
+
+	next->locked = 1;
+	if (pv) {
+		mb();
+		if (next->halted) {
+			kvm_hypercall(KVM_HC_KICK_CPU, 0, next->apic_id, 0, 0);
+			w->kicks++;
+		}
+	}
+}
+
+static void mcs_lock(struct worker *w)
+{
+	__mcs_lock(w, false);
+}
+
+static void mcs_unlock(struct worker *w)
+{
+	__mcs_unlock(w, false);
+}
+
+static bool pv_unhalt_supported(void)
+{
+	return kvm_para_has_feature(KVM_FEATURE_PV_UNHALT);
+}
+
+static void mcs_pv_lock(struct worker *w)
+{
+	__mcs_lock(w, true);
+}
+
+static void mcs_pv_unlock(struct worker *w)
+{
+	__mcs_unlock(w, true);
+}
+
+static const struct lock_algo algos[] = {
+	{ "tas", always, tas_lock, tas_unlock },
+	{ "ticket", always, ticket_lock, ticket_unlock },
+	{ "mcs", always, mcs_lock, mcs_unlock },
+	{ "mcs_pv", pv_unhalt_supported, mcs_pv_lock, mcs_pv_unlock },
+};
+
+static const struct lock_algo *algo;
+
+static void contend(void *data)
+{
+	struct worker *w = &workers[(long)data];
+	u64 start;
+
+	atomic_inc(&ready);
+	while (!go)
+		pause();
+
+	while ((start = rdtsc()) < run_end) {
+		algo->lock(w);
+		stats_hist_add(&w->wait, rdtsc() - start);
+		shared_counter++;
+		delay_cycles(cs_cycles);
+		algo->unlock(w);
+
+		w->acquisitions++;
+		delay_cycles(idle_cycles);
+	}
+}
+
+static void measure(int n)
+{
+	static struct stats_hist wait;
+	unsigned long acquisitions = 0, kicks = 0;
+	char name[64];
+	u64 rate;
+	int cpu;
+
+	for (cpu = 0; cpu < n; cpu++) {
+		workers[cpu].acquisitions = 0;
+		workers[cpu].kicks = 0;
+		workers[cpu].node.apic_id = id_map[cpu];
+		stats_hist_init(&workers[cpu].wait);
+	}
+	shared_counter = 0;
+	atomic_set(&ready, 0);
+	go = false;
+
+	for (cpu = 1; cpu < n; cpu++)
+		on_cpu_async(cpu, contend, (void *)(long)cpu);
+	while (atomic_read(&ready) < n - 1)
+		pause();
+
+	cli();
+	run_end = rdtsc() + run_cycles;
+	go = true;
+	contend((void *)0);
+	while (cpus_active() > 1)
+		pause();
+	sti();
+
+	stats_hist_init(&wait);
+	for (cpu = 0; cpu < n; cpu++) {
+		acquisitions += workers[cpu].acquisitions;
+		kicks += workers[cpu].kicks;
+		stats_hist_merge(&wait, &workers[cpu].wait);
+	}
+
+	snprintf(name, sizeof(name), "lock.%s@%d", algo->name, n);
+	rate = (u64)acquisitions * 1000000 / run_cycles;
+	if (tsc_hz())
+		printf("%s: %" PRIu64 " acquisitions/s", name,
+		       (u64)acquisitions * tsc_hz() / run_cycles);
+	else
+		printf("%s: %" PRIu64 " acquisitions/Mcycle", name, rate);
+	if (kicks)
+		printf(", %lu kicks", kicks);
+	printf("\n");
+	tsc_hist_print(name, &wait);
+	tsc_hist_record(name, nr_cpus, &wait);
+
+	report(shared_counter == acquisitions, "%s: mutual exclusion", name);
+}
+
+int main(int ac, char **av)
+{
+	u64 run_ms = 500;
+	int i, n;
+
+	nr_cpus = cpu_count();
+
+	if (ac > 1)
+		cs_cycles = atol(av[1]);
+	if (ac > 2)
+		idle_cycles = atol(av[2]);
+	if (ac > 3)
+		run_ms = atol(av[3]);
+	if (!run_ms)
+		report_abort("invalid duration '%s'", av[3]);
+
+	/* Assume 1 GHz if the TSC frequency is unknown. */
+	run_cycles = run_ms * (tsc_hz() ? tsc_hz() / 1000 : 1000000);
+
+	workers = memalign(__alignof__(*workers), nr_cpus * sizeof(*workers));
+	assert(workers);
+	memset(workers, 0, nr_cpus * sizeof(*workers));
+
+	printf("TSC frequency %" PRIu64 " kHz (%s)\n", tsc_hz() / 1000,
+	       tsc_hz_source());
+	printf("critical section %" PRIu64 " cycles, %" PRIu64
+	       " cycles between acquisitions, %" PRIu64 " ms per run\n",
+	       cs_cycles, idle_cycles, run_ms);
+
+	for (i = 0; i < ARRAY_SIZE(algos); i++) {
+		algo = &algos[i];
+		if (!algo->supported()) {
+			report_skip("%s: not supported", algo->name);
+			continue;
+		}
+
+		for (n = 1; ; n *= 2) {
+			n = MIN(n, nr_cpus);
+			measure(n);
+			if (n == nr_cpus)
+				break;
+		}
+	}
+
+	return report_summary();
+}
@@ -4,15 +4,20 @@
 #include "apic.h"
 #include "processor.h"
 #include "msr.h"
+#include "smp.h"
+#include "stats.h"
+#include "tsc.h"
 #include <stdlib.h>
 
 /**
- * This test allows two modes:
+ * This test allows three modes:
  * 1. Default: the `msr_info' array contains the default test configurations
  * 2. Custom: by providing command line arguments it is possible to test any MSR and value
  *	Parameters order:
  *		1. msr index as a base 16 number
  *		2. value as a base 16 number
+ * 3. Benchmark: "bench [iterations]" measures RDMSR and WRMSR for every MSR
+ *    in `msr_info' and `msr_bench_extra' that the vCPU supports
  */
 
 struct msr_info {
@@ -52,6 +57,124 @@ struct msr_info msr_info[] =
 //	MSR_VM_HSAVE_PA only AMD host
 };
 
+/*
+ * MSRs that are commonly accessed on hot paths, benchmarked in addition to
+ * msr_info.  Writes store the value that was read (or 0 for write-only
+ * MSRs), except for the TSC which is not written at all.
+ */
+struct msr_bench {
+	u32 index;
+	const char *name;
+	bool write;
+};
+
+#define MSR_BENCH(msr, wr)	{ .index = msr, .name = #msr, .write = wr }
+
+static struct msr_bench msr_bench_extra[] =
+{
+	MSR_BENCH(MSR_IA32_TSC, false),
+	MSR_BENCH(MSR_IA32_APICBASE, true),
+	MSR_BENCH(MSR_IA32_TSC_ADJUST, true),
+	MSR_BENCH(MSR_IA32_TSCDEADLINE, true),
+	MSR_BENCH(MSR_TSC_AUX, true),
+	MSR_BENCH(MSR_IA32_SPEC_CTRL, true),
+	MSR_BENCH(MSR_IA32_PRED_CMD, true),
+	MSR_BENCH(MSR_IA32_FLUSH_CMD, true),
+	MSR_BENCH(MSR_IA32_TSX_CTRL, true),
+	MSR_BENCH(MSR_IA32_DEBUGCTLMSR, true),
+};
+
+static unsigned long bench_iterations = 10000;
+static u64 bench_threshold;
+
+static u64 bench_p50(const char *op, const char *name, struct stats_hist *h)
+{
+	char rec[64];
+	u64 p50 = stats_hist_percentile(h, 500);
+
+	snprintf(rec, sizeof(rec), "%s.%s", op, name);
+	tsc_hist_record(rec, cpu_count(), h);
+	return p50;
+}
+
+static void bench_print(const char *op, const char *name, u64 p50)
+{
+	printf("%-8s %-28s %8" PRIu64 " cycles  %s\n", op, name, p50,
+	       p50 >= bench_threshold ? "intercepted" : "passthrough");
+}
+
+static void bench_msr(u32 index, const char *name, bool write)
+{
+	static struct stats_hist hist;
+	unsigned long i;
+	u64 val = 0, start;
+	bool readable;
+
+	readable = !rdmsr_safe(index, &val);
+	if (readable) {
+		stats_hist_init(&hist);
+		for (i = 0; i < bench_iterations; i++) {
+			start = rdtsc();
+			rdmsr(index);
+			stats_hist_add(&hist, rdtsc() - start);
+		}
+		bench_print("rdmsr", name, bench_p50("rdmsr", name, &hist));
+	}
+
+	if (!write || wrmsr_safe(index, val)) {
+		if (!readable)
+			report_skip("%s: not supported", name);
+		return;
+	}
+
+	stats_hist_init(&hist);
+	for (i = 0; i < bench_iterations; i++) {
+		start = rdtsc();
+		wrmsr(index, val);
+		stats_hist_add(&hist, rdtsc() - start);
+	}
+	bench_print("wrmsr", name, bench_p50("wrmsr", name, &hist));
+}
+
+/*
+ * There is no architectural way to tell whether an MSR is intercepted, so
+ * classify accesses by their cost: anything at least half as expensive as
+ * CPUID, which always exits, is assumed to exit too.  The records allow
+ * bench_compare.py to flag MSRs that become intercepted.
+ */
+static void bench_msrs(int ac, char **av)
+{
+	static struct stats_hist hist;
+	bool is_64bit_host = this_cpu_has(X86_FEATURE_LM);
+	unsigned long i;
+	u64 start;
+
+	if (ac > 2)
+		bench_iterations = atol(av[2]);
+
+	stats_hist_init(&hist);
+	for (i = 0; i < bench_iterations; i++) {
+		start = rdtsc();
+		raw_cpuid(0, 0);
+		stats_hist_add(&hist, rdtsc() - start);
+	}
+	bench_threshold = stats_hist_percentile(&hist, 500) / 2;
+	printf("cpuid p50 %" PRIu64 " cycles, intercept threshold %" PRIu64
+	       " cycles\n", stats_hist_percentile(&hist, 500), bench_threshold);
+
+	for (i = 0; i < ARRAY_SIZE(msr_info); i++) {
+		if (msr_info[i].is_64bit_only && !is_64bit_host)
+			continue;
+		bench_msr(msr_info[i].index, msr_info[i].name, true);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(msr_bench_extra); i++)
+		bench_msr(msr_bench_extra[i].index, msr_bench_extra[i].name,
+			  msr_bench_extra[i].write);
+
+	report_pass("MSR benchmark");
+}
+
 static void __test_msr_rw(u32 msr, const char *name, unsigned long long val,
 			  unsigned long long keep_mask)
 {
@@ -312,7 +435,9 @@ int main(int ac, char **av)
 	 * If the user provided an MSR+value, test exactly that and skip all
 	 * built-in testcases.
 	 */
-	if (ac == 3) {
+	if (ac > 1 && !strcmp(av[1], "bench")) {
+		bench_msrs(ac, av);
+	} else if (ac == 3) {
 		test_custom_msr(ac, av);
 	} else {
 		test_misc_msrs();
@@ -1,47 +1,206 @@
-/* test long rmap chains */
+/*
+ * Test long rmap chains
+ *
+ * Maps a few target pages at many guest virtual addresses ("aliases"),
+ * alias i mapping target i % targets, and times each phase per alias:
+ *
+ * - install: write the PTEs of all aliases, on vCPU 0.
+ * - touch:   read every alias once, so that KVM creates the mappings.
+ * - remap:   point every alias to the next target, INVLPG it and read it.
+ * - unmap:   clear the PTE of every alias and INVLPG it.
+ *
+ * The touch, remap and unmap phases are split among the vCPUs, each of
+ * them handling its own slice of the aliases.  KVM only keeps rmap chains
+ * for guest page tables when it shadows them, i.e. with shadow paging
+ * (e.g. kvm_intel.ept=0) or for a nested guest, so that is where the
+ * phases show how KVM's rmap handling scales with heavily aliased memory,
+ * such as pages deduplicated by KSM.
+ *
+ * Usage: rmap_chain.flat [aliases, 0 for the default] [targets] [vcpus]
+ */
 
 #include "libcflat.h"
+#include "alloc.h"
 #include "fwcfg.h"
+#include "processor.h"
 #include "vm.h"
 #include "vmalloc.h"
 #include "smp.h"
 #include "alloc_page.h"
+#include "stats.h"
+#include "tsc.h"
 
-int main (void)
+#define ALIAS_BASE	((u8 *)0xfffffa000ul)
+#define TARGET_MAGIC	0x726d6170ul
+
+struct worker {
+    unsigned long first, last;
+    unsigned long errors;
+    struct stats_hist hist;
+} __attribute__((aligned(64)));
+
+static unsigned long nr_aliases;
+static int nr_targets = 1;
+static int nr_vcpus;
+static void **targets;
+static struct worker *workers;
+static pgd_t *cr3;
+
+static void *alias(unsigned long i)
+{
+    return ALIAS_BASE + i * PAGE_SIZE;
+}
+
+static int target_of(unsigned long i, int shift)
+{
+    return (i + shift) % nr_targets;
+}
+
+static bool check_alias(unsigned long i, int shift)
+{
+    return *(volatile unsigned long *)alias(i) ==
+           TARGET_MAGIC + target_of(i, shift);
+}
+
+static void touch(void *data)
+{
+    struct worker *w = data;
+    unsigned long i;
+    u64 start;
+
+    for (i = w->first; i < w->last; i++) {
+        start = rdtsc();
+        if (!check_alias(i, 0))
+            w->errors++;
+        stats_hist_add(&w->hist, rdtsc() - start);
+    }
+}
+
+static void remap(void *data)
+{
+    struct worker *w = data;
+    pteval_t *pte;
+    unsigned long i;
+    u64 start;
+
+    for (i = w->first; i < w->last; i++) {
+        start = rdtsc();
+        pte = get_pte(cr3, alias(i));
+        *pte = (*pte & ~PT_ADDR_MASK) |
+               virt_to_phys(targets[target_of(i, 1)]);
+        invlpg(alias(i));
+        if (!check_alias(i, 1))
+            w->errors++;
+        stats_hist_add(&w->hist, rdtsc() - start);
+    }
+}
+
+static void unmap(void *data)
+{
+    struct worker *w = data;
+    unsigned long i;
+    u64 start;
+
+    for (i = w->first; i < w->last; i++) {
+        start = rdtsc();
+        *get_pte(cr3, alias(i)) = 0;
+        invlpg(alias(i));
+        stats_hist_add(&w->hist, rdtsc() - start);
+    }
+}
+
+static void run_phase(const char *phase, void (*fn)(void *))
 {
-    int i;
-    int nr_pages;
-    void *target_page, *virt_addr;
+    static struct stats_hist total;
+    unsigned long errors = 0;
+    char name[64];
+    u64 start, elapsed;
+    int cpu;
+
+    for (cpu = 0; cpu < nr_vcpus; cpu++) {
+        workers[cpu].first = nr_aliases * cpu / nr_vcpus;
+        workers[cpu].last = nr_aliases * (cpu + 1) / nr_vcpus;
+        workers[cpu].errors = 0;
+        stats_hist_init(&workers[cpu].hist);
+    }
+
+    start = rdtsc();
+    for (cpu = 1; cpu < nr_vcpus; cpu++)
+        on_cpu_async(cpu, fn, &workers[cpu]);
+    fn(&workers[0]);
+    while (cpus_active() > 1)
+        pause();
+    elapsed = rdtsc() - start;
+
+    stats_hist_init(&total);
+    for (cpu = 0; cpu < nr_vcpus; cpu++) {
+        stats_hist_merge(&total, &workers[cpu].hist);
+        errors += workers[cpu].errors;
+    }
+
+    printf("%s: %lu aliases on %d vcpus in %" PRIu64 " us\n", phase,
+           nr_aliases, nr_vcpus, tsc_to_ns(elapsed) / 1000);
+    snprintf(name, sizeof(name), "rmap_chain.%s@%d", phase, nr_vcpus);
+    tsc_hist_print(name, &total);
+    tsc_hist_record(name, cpu_count(), &total);
+    report(!errors, "%s (%lu wrong values)", phase, errors);
+}
+
+int main(int ac, char **av)
+{
+    static struct stats_hist install;
+    unsigned long i;
+    void *virt_addr;
+    u64 start;
 
     setup_vm();
+    cr3 = phys_to_virt(read_cr3());
 
-    nr_pages = fwcfg_get_u64(FW_CFG_RAM_SIZE) / PAGE_SIZE;
-    nr_pages -= 1000;
-    target_page = alloc_page();
+    nr_vcpus = cpu_count();
+    if (ac > 1)
+        nr_aliases = atol(av[1]);
+    if (ac > 2)
+        nr_targets = atol(av[2]);
+    if (ac > 3)
+        nr_vcpus = MIN(atol(av[3]), cpu_count());
+    if (!nr_aliases)
+        nr_aliases = fwcfg_get_u64(FW_CFG_RAM_SIZE) / PAGE_SIZE - 1000;
+    if (nr_targets < 1 || nr_vcpus < 1)
+        report_abort("invalid number of targets or vcpus");
 
-    virt_addr = (void *) 0xfffffa000;
-    for (i = 0; i < nr_pages; i++) {
-        install_page(phys_to_virt(read_cr3()), virt_to_phys(target_page),
-                     virt_addr);
-        virt_addr += PAGE_SIZE;
+    targets = calloc(nr_targets, sizeof(*targets));
+    assert(targets);
+    for (i = 0; i < nr_targets; i++) {
+        targets[i] = alloc_page();
+        *(unsigned long *)targets[i] = TARGET_MAGIC + i;
     }
-    printf("created %d mappings\n", nr_pages);
 
-    virt_addr = (void *) 0xfffffa000;
-    for (i = 0; i < nr_pages; i++) {
-        unsigned long *touch = virt_addr;
+    workers = memalign(__alignof__(*workers), nr_vcpus * sizeof(*workers));
+    assert(workers);
 
-        *touch = 0;
-        virt_addr += PAGE_SIZE;
+    printf("TSC frequency %" PRIu64 " kHz (%s)\n", tsc_hz() / 1000,
+           tsc_hz_source());
+
+    stats_hist_init(&install);
+    for (i = 0; i < nr_aliases; i++) {
+        start = rdtsc();
+        install_page(cr3, virt_to_phys(targets[target_of(i, 0)]), alias(i));
+        stats_hist_add(&install, rdtsc() - start);
     }
-    printf("instantiated mappings\n");
+    printf("created %lu mappings of %d pages\n", nr_aliases, nr_targets);
+    tsc_hist_print("rmap_chain.install", &install);
+    tsc_hist_record("rmap_chain.install", cpu_count(), &install);
 
-    virt_addr += PAGE_SIZE;
-    install_pte(phys_to_virt(read_cr3()), 1, virt_addr,
-                0 | PT_PRESENT_MASK | PT_WRITABLE_MASK, target_page);
+    run_phase("touch", touch);
+    run_phase("remap", remap);
 
+    /* Use a heavily aliased page as a page table. */
+    virt_addr = alias(nr_aliases + 1);
+    install_pte(cr3, 1, virt_addr,
+                0 | PT_PRESENT_MASK | PT_WRITABLE_MASK, targets[0]);
     *(unsigned long *)virt_addr = 0;
-    printf("PASS\n");
 
-    return 0;
+    run_phase("unmap", unmap);
+
+    return report_summary();
 }
@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Self-check of the histogram in lib/stats.c
+ *
+ * Each value is recorded between a 0 and a ~0 sample, so that the median
+ * is the lower bound of the value's bucket rather than the exact minimum
+ * or maximum.
+ */
+#include "libcflat.h"
+#include "stats.h"
+
+static const struct {
+	u64 val;
+	u64 base;
+} cases[] = {
+	{ 1, 1 },
+	{ 15, 15 },
+	{ 16, 16 },
+	{ 17, 17 },
+	{ 31, 31 },
+	{ 32, 32 },
+	{ 33, 32 },
+	{ 100, 100 },
+	{ 1000, 992 },
+	{ 2000, 1984 },
+	{ 1ull << 63, 1ull << 63 },
+	{ ~0ull - 1, 0xf800000000000000ull },
+};
+
+static struct stats_hist hist;
+
+int main(void)
+{
+	u64 base;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		stats_hist_init(&hist);
+		stats_hist_add(&hist, 0);
+		stats_hist_add(&hist, cases[i].val);
+		stats_hist_add(&hist, ~0ull);
+		base = stats_hist_percentile(&hist, 500);
+		report(base == cases[i].base,
+		       "bucket of %" PRIu64 ": %" PRIu64 " == %" PRIu64,
+		       cases[i].val, base, cases[i].base);
+	}
+
+	return report_summary();
+}
@@ -12,6 +12,8 @@
 #include "util.h"
 #include "x86/usermode.h"
 #include "vmalloc.h"
+#include "stats.h"
+#include "tsc.h"
 
 #define SVM_EXIT_MAX_DR_INTERCEPT 0x3f
 
@@ -20,13 +22,9 @@
 u64 tsc_start;
 u64 tsc_end;
 
-u64 vmrun_sum, vmexit_sum;
+struct stats_hist latvmrun_hist, latvmexit_hist;
 u64 vmsave_sum, vmload_sum;
 u64 stgi_sum, clgi_sum;
-u64 latvmrun_max;
-u64 latvmrun_min;
-u64 latvmexit_max;
-u64 latvmexit_min;
 u64 latvmload_max;
 u64 latvmload_min;
 u64 latvmsave_max;
@@ -809,28 +807,17 @@ static void latency_prepare(struct svm_test *test)
 {
 	default_prepare(test);
 	runs = LATENCY_RUNS;
-	latvmrun_min = latvmexit_min = -1ULL;
-	latvmrun_max = latvmexit_max = 0;
-	vmrun_sum = vmexit_sum = 0;
+	stats_hist_init(&latvmrun_hist);
+	stats_hist_init(&latvmexit_hist);
 	tsc_start = rdtsc();
 }
 
 static void latency_test(struct svm_test *test)
 {
-	u64 cycles;
-
 start:
 	tsc_end = rdtsc();
 
-	cycles = tsc_end - tsc_start;
-
-	if (cycles > latvmrun_max)
-		latvmrun_max = cycles;
-
-	if (cycles < latvmrun_min)
-		latvmrun_min = cycles;
-
-	vmrun_sum += cycles;
+	stats_hist_add(&latvmrun_hist, tsc_end - tsc_start);
 
 	tsc_start = rdtsc();
 
@@ -840,19 +827,9 @@ start:
 
 static bool latency_finished(struct svm_test *test)
 {
-	u64 cycles;
-
 	tsc_end = rdtsc();
 
-	cycles = tsc_end - tsc_start;
-
-	if (cycles > latvmexit_max)
-		latvmexit_max = cycles;
-
-	if (cycles < latvmexit_min)
-		latvmexit_min = cycles;
-
-	vmexit_sum += cycles;
+	stats_hist_add(&latvmexit_hist, tsc_end - tsc_start);
 
 	vmcb->save.rip += 3;
 
@@ -871,10 +848,15 @@ static bool latency_finished_clean(struct svm_test *test)
 
 static bool latency_check(struct svm_test *test)
 {
-	printf("    Latency VMRUN : max: %ld min: %ld avg: %ld\n", latvmrun_max,
-	       latvmrun_min, vmrun_sum / LATENCY_RUNS);
-	printf("    Latency VMEXIT: max: %ld min: %ld avg: %ld\n", latvmexit_max,
-	       latvmexit_min, vmexit_sum / LATENCY_RUNS);
+	char name[64];
+
+	snprintf(name, sizeof(name), "%s.vmrun", test->name);
+	tsc_hist_print(name, &latvmrun_hist);
+	tsc_hist_record(name, cpu_count(), &latvmrun_hist);
+
+	snprintf(name, sizeof(name), "%s.vmexit", test->name);
+	tsc_hist_print(name, &latvmexit_hist);
+	tsc_hist_record(name, cpu_count(), &latvmexit_hist);
 	return true;
 }
 
@@ -948,6 +930,301 @@ static bool lat_svm_insn_check(struct svm_test *test)
 	return true;
 }
 
+/*
+ * Round trips from L2 through L1 for several exit types, each repeated with
+ * no VMCB clean bits, with all of them and with every clean bit but one.
+ * The difference between a row and the "dirty_none" row is what L0 spends
+ * re-syncing that group of VMCB fields on nested VMRUN.  L1 changes nothing
+ * but RIP between runs, so the clean bits are always truthful.
+ */
+#define LATENCY_MATRIX_WARMUP	100
+#define LATENCY_MATRIX_RUNS	10000
+#define LATENCY_MATRIX_MSR	MSR_IA32_SYSENTER_CS
+#define LATENCY_MATRIX_PORT	0x80
+#define LATENCY_MATRIX_VECTOR	0xe4
+
+struct lat_exit {
+	const char *name;
+	u32 exit_code;
+	bool (*supported)(void);
+	void (*setup)(void);
+	void (*op)(void);
+	void (*cleanup)(void);
+};
+
+struct lat_clean {
+	const char *name;
+	u32 bits;
+};
+
+static const struct lat_clean lat_cleans[] = {
+	{ "dirty_all", 0 },
+	{ "dirty_intercepts", VMCB_CLEAN_ALL & ~VMCB_CLEAN_INTERCEPTS },
+	{ "dirty_perm_map", VMCB_CLEAN_ALL & ~VMCB_CLEAN_PERM_MAP },
+	{ "dirty_asid", VMCB_CLEAN_ALL & ~VMCB_CLEAN_ASID },
+	{ "dirty_intr", VMCB_CLEAN_ALL & ~VMCB_CLEAN_INTR },
+	{ "dirty_npt", VMCB_CLEAN_ALL & ~VMCB_CLEAN_NPT },
+	{ "dirty_cr", VMCB_CLEAN_ALL & ~VMCB_CLEAN_CR },
+	{ "dirty_dr", VMCB_CLEAN_ALL & ~VMCB_CLEAN_DR },
+	{ "dirty_dt", VMCB_CLEAN_ALL & ~VMCB_CLEAN_DT },
+	{ "dirty_seg", VMCB_CLEAN_ALL & ~VMCB_CLEAN_SEG },
+	{ "dirty_cr2", VMCB_CLEAN_ALL & ~VMCB_CLEAN_CR2 },
+	{ "dirty_lbr", VMCB_CLEAN_ALL & ~VMCB_CLEAN_LBR },
+	{ "dirty_avic", VMCB_CLEAN_ALL & ~VMCB_CLEAN_AVIC },
+	{ "dirty_none", VMCB_CLEAN_ALL },
+};
+
+static u8 *lat_npf_page;
+
+static void lat_nop(void)
+{
+}
+
+static void lat_vmmcall_op(void)
+{
+	vmmcall();
+}
+
+static void lat_cpuid_setup(void)
+{
+	vmcb->control.intercept |= (1ULL << INTERCEPT_CPUID);
+}
+
+static void lat_cpuid_op(void)
+{
+	raw_cpuid(0, 0);
+}
+
+static void lat_cpuid_cleanup(void)
+{
+	vmcb->control.intercept &= ~(1ULL << INTERCEPT_CPUID);
+}
+
+static void lat_msr_setup(void)
+{
+	vmcb->control.intercept |= (1ULL << INTERCEPT_MSR_PROT);
+	memset(msr_bitmap, 0xff, MSR_BITMAP_SIZE);
+}
+
+static void lat_msr_op(void)
+{
+	rdmsr(LATENCY_MATRIX_MSR);
+}
+
+static void lat_msr_cleanup(void)
+{
+	memset(msr_bitmap, 0, MSR_BITMAP_SIZE);
+	vmcb->control.intercept &= ~(1ULL << INTERCEPT_MSR_PROT);
+}
+
+static void lat_ioio_setup(void)
+{
+	vmcb->control.intercept |= (1ULL << INTERCEPT_IOIO_PROT);
+	io_bitmap[LATENCY_MATRIX_PORT / 8] |= 1 << (LATENCY_MATRIX_PORT % 8);
+}
+
+static void lat_ioio_op(void)
+{
+	inb(LATENCY_MATRIX_PORT);
+}
+
+static void lat_ioio_cleanup(void)
+{
+	io_bitmap[LATENCY_MATRIX_PORT / 8] &= ~(1 << (LATENCY_MATRIX_PORT % 8));
+	vmcb->control.intercept &= ~(1ULL << INTERCEPT_IOIO_PROT);
+}
+
+static void lat_npf_setup(void)
+{
+	lat_npf_page = alloc_page();
+	*npt_get_pte(virt_to_phys(lat_npf_page)) &= ~PT_WRITABLE_MASK;
+}
+
+static void lat_npf_op(void)
+{
+	/* Two bytes, skipped by L1 as NPF exits have no next RIP. */
+	asm volatile("mov %%eax, (%%rbx)"
+		     : : "a"(0), "b"(lat_npf_page) : "memory");
+}
+
+static void lat_npf_cleanup(void)
+{
+	*npt_get_pte(virt_to_phys(lat_npf_page)) |= PT_WRITABLE_MASK;
+	free_page(lat_npf_page);
+}
+
+static void lat_intr_isr(isr_regs_t *regs)
+{
+	eoi();
+}
+
+static void lat_intr_setup(void)
+{
+	vmcb->control.intercept |= (1ULL << INTERCEPT_INTR);
+	vmcb->control.int_ctl |= V_INTR_MASKING_MASK;
+}
+
+static void lat_intr_op(void)
+{
+	apic_icr_write(APIC_DEST_SELF | APIC_DEST_PHYSICAL | APIC_DM_FIXED |
+		       LATENCY_MATRIX_VECTOR, 0);
+}
+
+static void lat_intr_cleanup(void)
+{
+	vmcb->control.intercept &= ~(1ULL << INTERCEPT_INTR);
+	vmcb->control.int_ctl &= ~V_INTR_MASKING_MASK;
+}
+
+static const struct lat_exit lat_exits[] = {
+	{ "vmmcall", SVM_EXIT_VMMCALL, default_supported, lat_nop,
+	  lat_vmmcall_op, lat_nop },
+	{ "cpuid", SVM_EXIT_CPUID, default_supported, lat_cpuid_setup,
+	  lat_cpuid_op, lat_cpuid_cleanup },
+	{ "msr", SVM_EXIT_MSR, default_supported, lat_msr_setup,
+	  lat_msr_op, lat_msr_cleanup },
+	{ "ioio", SVM_EXIT_IOIO, default_supported, lat_ioio_setup,
+	  lat_ioio_op, lat_ioio_cleanup },
+	{ "npf", SVM_EXIT_NPF, npt_supported, lat_npf_setup,
+	  lat_npf_op, lat_npf_cleanup },
+	{ "intr", SVM_EXIT_INTR, default_supported, lat_intr_setup,
+	  lat_intr_op, lat_intr_cleanup },
+};
+
+static struct stats_hist lat_hist;
+static u64 lat_p50[ARRAY_SIZE(lat_cleans)][ARRAY_SIZE(lat_exits)];
+static volatile unsigned int lat_exit, lat_clean, lat_iter, lat_cell;
+static bool lat_failed;
+
+/* Select the first supported exit type starting at @i, false if none. */
+static bool latency_matrix_select(unsigned int i)
+{
+	for (; i < ARRAY_SIZE(lat_exits); i++) {
+		if (lat_exits[i].supported()) {
+			lat_exit = i;
+			lat_exits[i].setup();
+			return true;
+		}
+		report_skip("latency_matrix: %s not supported", lat_exits[i].name);
+	}
+	return false;
+}
+
+static void latency_matrix_prepare(struct svm_test *test)
+{
+	default_prepare(test);
+	handle_irq(LATENCY_MATRIX_VECTOR, lat_intr_isr);
+	memset(lat_p50, 0, sizeof(lat_p50));
+	stats_hist_init(&lat_hist);
+	lat_clean = lat_iter = lat_cell = 0;
+	lat_failed = false;
+	latency_matrix_select(0);
+}
+
+/*
+ * The cell is sampled before the exit, so that a sample whose exit moved
+ * L1 to the next cell is dropped instead of being counted in the new one.
+ */
+static void latency_matrix_test(struct svm_test *test)
+{
+	unsigned int cell, iter;
+	u64 start, cycles;
+
+	for (;;) {
+		cell = lat_cell;
+		iter = lat_iter;
+		start = rdtsc();
+		lat_exits[lat_exit].op();
+		cycles = rdtsc() - start;
+		if (cell == lat_cell && iter >= LATENCY_MATRIX_WARMUP)
+			stats_hist_add(&lat_hist, cycles);
+	}
+}
+
+static void latency_matrix_record(void)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "svm.%s.%s", lat_exits[lat_exit].name,
+		 lat_cleans[lat_clean].name);
+	tsc_hist_print(name, &lat_hist);
+	tsc_hist_record(name, cpu_count(), &lat_hist);
+	lat_p50[lat_clean][lat_exit] = stats_hist_percentile(&lat_hist, 500);
+	stats_hist_init(&lat_hist);
+}
+
+static bool latency_matrix_finished(struct svm_test *test)
+{
+	const struct lat_exit *e = &lat_exits[lat_exit];
+	u32 exit_code = vmcb->control.exit_code;
+
+	if (exit_code != e->exit_code) {
+		report_fail("latency_matrix: %s: unexpected exit 0x%x",
+			    e->name, exit_code);
+		e->cleanup();
+		lat_failed = true;
+		return true;
+	}
+
+	switch (exit_code) {
+	case SVM_EXIT_VMMCALL:
+		vmcb->save.rip += 3;
+		break;
+	case SVM_EXIT_CPUID:
+	case SVM_EXIT_MSR:
+	case SVM_EXIT_NPF:
+		vmcb->save.rip += 2;
+		break;
+	case SVM_EXIT_IOIO:
+		vmcb->save.rip = vmcb->control.exit_info_2;
+		break;
+	case SVM_EXIT_INTR:
+		sti_nop_cli();
+		break;
+	}
+
+	/* Only flush the TLB when the intercepts or the NPT change. */
+	vmcb->control.tlb_ctl = TLB_CONTROL_DO_NOTHING;
+	if (++lat_iter <= LATENCY_MATRIX_WARMUP + LATENCY_MATRIX_RUNS) {
+		vmcb->control.clean = lat_cleans[lat_clean].bits;
+		return false;
+	}
+
+	latency_matrix_record();
+	lat_iter = 0;
+	lat_cell++;
+	vmcb->control.clean = 0;
+	vmcb->control.tlb_ctl = TLB_CONTROL_FLUSH_ALL_ASID;
+	if (++lat_clean < ARRAY_SIZE(lat_cleans))
+		return false;
+
+	lat_clean = 0;
+	e->cleanup();
+	return !latency_matrix_select(lat_exit + 1);
+}
+
+static bool latency_matrix_check(struct svm_test *test)
+{
+	int i, j;
+
+	printf("    p50 round trip in cycles:\n    %-16s", "");
+	for (j = 0; j < ARRAY_SIZE(lat_exits); j++)
+		printf(" %8s", lat_exits[j].name);
+	printf("\n");
+
+	for (i = 0; i < ARRAY_SIZE(lat_cleans); i++) {
+		printf("    %-16s", lat_cleans[i].name);
+		for (j = 0; j < ARRAY_SIZE(lat_exits); j++) {
+			if (lat_p50[i][j])
+				printf(" %8" PRIu64, lat_p50[i][j]);
+			else
+				printf(" %8s", "-");
+		}
+		printf("\n");
+	}
+	return !lat_failed;
+}
+
 /*
  * Report failures from SVM guest code, and on failure, set the stage to -1 and
  * do VMMCALL to terminate the test (host side must treat -1 as "finished").
@@ -3327,6 +3604,9 @@ struct svm_test svm_tests[] = {
 	{ "latency_svm_insn", default_supported, lat_svm_insn_prepare,
 	  default_prepare_gif_clear, null_test,
 	  lat_svm_insn_finished, lat_svm_insn_check },
+	{ "latency_matrix", default_supported, latency_matrix_prepare,
+	  default_prepare_gif_clear, latency_matrix_test,
+	  latency_matrix_finished, latency_matrix_check },
 	{ "exc_inject", default_supported, exc_inject_prepare,
 	  default_prepare_gif_clear, exc_inject_test,
 	  exc_inject_finished, exc_inject_check },
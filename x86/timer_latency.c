@@ -0,0 +1,277 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Interrupt latency of the APIC timer, the TSC deadline timer and the
+ * Hyper-V synthetic timer
+ *
+ * vCPU0 arms each timer in one-shot mode for the same set of intervals,
+ * halts, and measures how long after the expected expiry the interrupt
+ * handler runs.  The expected expiry is computed with the TSC: for the
+ * APIC timer from its frequency, calibrated against the TSC at start, and
+ * for the synthetic timer from the reference counter (in 100ns units)
+ * read right before arming it.  Interrupts that arrive before the
+ * expected expiry are counted and left out of the latencies.  Only the
+ * TSC deadline is exact, so only early TSC deadline interrupts fail the
+ * test; for the other timers they show calibration error.
+ *
+ * Every measurement is repeated while the other vCPUs spin on CPUID, to
+ * see how the timer path behaves when the host is busy handling exits.
+ *
+ * Usage: timer_latency.flat [samples]
+ */
+#include "libcflat.h"
+#include "alloc_page.h"
+#include "apic.h"
+#include "hyperv.h"
+#include "isr.h"
+#include "msr.h"
+#include "processor.h"
+#include "smp.h"
+#include "stats.h"
+#include "tsc.h"
+#include "vm.h"
+
+#define TIMER_VEC	0xee
+#define STIMER_VEC	0xf1
+#define STIMER_SINT	2
+#define STIMER_INDEX	0
+
+#define APIC_CALIBRATION_NS	(10 * 1000 * 1000)
+
+struct timer_type {
+	const char *name;
+	bool exact;
+	bool (*supported)(void);
+	void (*setup)(void);
+	/* Arm the timer to fire after @ns, return the expected expiry TSC. */
+	u64 (*arm)(u64 ns);
+	void (*cleanup)(void);
+};
+
+static const u64 intervals_us[] = { 10, 50, 100, 500, 1000 };
+
+static unsigned long nr_samples = 1000;
+static volatile u64 fired_tsc;
+static volatile bool stop_load;
+static unsigned long early;
+
+static u64 apic_timer_hz;
+static struct hv_message_page *msg_page;
+
+static u64 ns_to_tsc(u64 ns)
+{
+	return ns * (tsc_hz() / 1000) / 1000000;
+}
+
+static void timer_isr(isr_regs_t *regs)
+{
+	fired_tsc = rdtsc();
+	eoi();
+}
+
+static void stimer_isr(isr_regs_t *regs)
+{
+	struct hv_message *msg = &msg_page->sint_message[STIMER_SINT];
+
+	fired_tsc = rdtsc();
+	msg->header.message_type = HVMSG_NONE;
+	mb();
+	if (msg->header.message_flags.msg_pending)
+		wrmsr(HV_X64_MSR_EOM, 0);
+	eoi();
+}
+
+static bool apic_oneshot_supported(void)
+{
+	return true;
+}
+
+/* Count the APIC timer down with the divider at 1 for a known time. */
+static void apic_oneshot_setup(void)
+{
+	u64 start, elapsed;
+	u32 left;
+
+	apic_setup_timer(TIMER_VEC | APIC_LVT_MASKED, APIC_LVT_TIMER_ONESHOT);
+	start = rdtsc();
+	apic_start_timer(0xffffffff);
+	while (rdtsc() - start < ns_to_tsc(APIC_CALIBRATION_NS))
+		pause();
+	left = apic_read(APIC_TMCCT);
+	elapsed = rdtsc() - start;
+	apic_stop_timer();
+
+	apic_timer_hz = (u64)(0xffffffff - left) * tsc_hz() / elapsed;
+	printf("APIC timer frequency %" PRIu64 " kHz\n", apic_timer_hz / 1000);
+
+	apic_setup_timer(TIMER_VEC, APIC_LVT_TIMER_ONESHOT);
+}
+
+static u64 apic_oneshot_arm(u64 ns)
+{
+	u64 now = rdtsc();
+
+	apic_start_timer(ns * (apic_timer_hz / 1000) / 1000000);
+	return now + ns_to_tsc(ns);
+}
+
+static bool tscdeadline_supported(void)
+{
+	return this_cpu_has(X86_FEATURE_TSC_DEADLINE_TIMER);
+}
+
+static void tscdeadline_setup(void)
+{
+	apic_setup_timer(TIMER_VEC, APIC_LVT_TIMER_TSCDEADLINE);
+}
+
+static u64 tscdeadline_arm(u64 ns)
+{
+	u64 deadline = rdtsc() + ns_to_tsc(ns);
+
+	wrmsr(MSR_IA32_TSCDEADLINE, deadline);
+	return deadline;
+}
+
+static void tscdeadline_cleanup(void)
+{
+	wrmsr(MSR_IA32_TSCDEADLINE, 0);
+	apic_cleanup_timer();
+}
+
+static bool stimer_available(void)
+{
+	return synic_supported() && stimer_supported() &&
+	       hv_time_ref_counter_supported();
+}
+
+static void stimer_setup(void)
+{
+	msg_page = alloc_page();
+	memset(msg_page, 0, PAGE_SIZE);
+	wrmsr(HV_X64_MSR_SIMP,
+	      (u64)virt_to_phys(msg_page) | HV_SYNIC_SIMP_ENABLE);
+	wrmsr(HV_X64_MSR_SCONTROL, HV_SYNIC_CONTROL_ENABLE);
+	wrmsr(HV_X64_MSR_SINT0 + STIMER_SINT, STIMER_VEC);
+}
+
+static u64 stimer_arm(u64 ns)
+{
+	u64 config = HV_STIMER_ENABLE | ((u64)STIMER_SINT << 16);
+	u64 tsc = rdtsc();
+	u64 ref = rdmsr(HV_X64_MSR_TIME_REF_COUNT);
+
+	wrmsr(HV_X64_MSR_STIMER0_COUNT + 2 * STIMER_INDEX, ref + ns / 100);
+	wrmsr(HV_X64_MSR_STIMER0_CONFIG + 2 * STIMER_INDEX, config);
+	return tsc + ns_to_tsc(ns / 100 * 100);
+}
+
+static void stimer_cleanup(void)
+{
+	wrmsr(HV_X64_MSR_STIMER0_CONFIG + 2 * STIMER_INDEX, 0);
+	wrmsr(HV_X64_MSR_SINT0 + STIMER_SINT, HV_SYNIC_SINT_MASKED);
+	wrmsr(HV_X64_MSR_SCONTROL, 0);
+	wrmsr(HV_X64_MSR_SIMP, 0);
+	free_page(msg_page);
+}
+
+static const struct timer_type timers[] = {
+	{ "apic_oneshot", false, apic_oneshot_supported, apic_oneshot_setup,
+	  apic_oneshot_arm, apic_cleanup_timer },
+	{ "tscdeadline", true, tscdeadline_supported, tscdeadline_setup,
+	  tscdeadline_arm, tscdeadline_cleanup },
+	{ "hv_stimer", false, stimer_available, stimer_setup, stimer_arm,
+	  stimer_cleanup },
+};
+
+static void exit_load(void *data)
+{
+	while (!stop_load)
+		cpuid(0);
+}
+
+static void measure(const struct timer_type *t, u64 us, bool load)
+{
+	static struct stats_hist hist;
+	unsigned long s, nr_early = 0;
+	u64 expected;
+	char name[64];
+	int cpu;
+
+	stop_load = false;
+	if (load)
+		for (cpu = 1; cpu < cpu_count(); cpu++)
+			on_cpu_async(cpu, exit_load, NULL);
+
+	stats_hist_init(&hist);
+	for (s = 0; s < nr_samples; s++) {
+		cli();
+		fired_tsc = 0;
+		expected = t->arm(us * 1000);
+		while (!fired_tsc) {
+			safe_halt();
+			cli();
+		}
+
+		if (fired_tsc < expected)
+			nr_early++;
+		else
+			stats_hist_add(&hist, fired_tsc - expected);
+	}
+	sti();
+
+	stop_load = true;
+	while (cpus_active() > 1)
+		pause();
+
+	snprintf(name, sizeof(name), "timer.%s.%" PRIu64 "us%s", t->name, us,
+		 load ? "+load" : "");
+	if (nr_early)
+		printf("%s: %lu interrupts before the expected expiry\n", name,
+		       nr_early);
+	if (t->exact)
+		early += nr_early;
+	tsc_hist_print(name, &hist);
+	tsc_hist_record(name, cpu_count(), &hist);
+}
+
+int main(int ac, char **av)
+{
+	const struct timer_type *t;
+	int i, j;
+
+	setup_vm();
+
+	if (ac > 1)
+		nr_samples = atol(av[1]);
+
+	if (!tsc_hz()) {
+		report_skip("TSC frequency unknown");
+		return report_summary();
+	}
+	printf("TSC frequency %" PRIu64 " kHz (%s)\n", tsc_hz() / 1000,
+	       tsc_hz_source());
+
+	handle_irq(TIMER_VEC, timer_isr);
+	handle_irq(STIMER_VEC, stimer_isr);
+
+	for (i = 0; i < ARRAY_SIZE(timers); i++) {
+		t = &timers[i];
+		if (!t->supported()) {
+			report_skip("%s not supported", t->name);
+			continue;
+		}
+
+		t->setup();
+		for (j = 0; j < ARRAY_SIZE(intervals_us); j++) {
+			measure(t, intervals_us[j], false);
+			if (cpu_count() > 1)
+				measure(t, intervals_us[j], true);
+		}
+		t->cleanup();
+		report_pass("%s", t->name);
+	}
+
+	report(!early, "no TSC deadline interrupts before the deadline "
+	       "(%lu early)", early);
+	return report_summary();
+}
@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Cost of TLB maintenance operations
+ *
+ * Measures INVLPG, the four INVPCID types and CR3 writes that switch
+ * round-robin between a number of address spaces, without PCID, with PCID
+ * and with PCID and the NOFLUSH bit.  The CR3 writes are measured alone
+ * and followed by reads of a small working set, to include the cost of
+ * refilling the TLB.  All address spaces map the same memory; each one
+ * has its own root page table and, with PCID, its own PCID.
+ *
+ * With EPT/NPT, INVLPG, INVPCID and CR3 writes usually do not exit, while
+ * with shadow paging (e.g. kvm_intel.ept=0) they all do, so comparing the
+ * two shows the context-switch overhead of each configuration.
+ *
+ * Usage: tlbflush.flat [address spaces, default 16] [samples]
+ */
+#include "libcflat.h"
+#include "alloc.h"
+#include "alloc_page.h"
+#include "bitops.h"
+#include "processor.h"
+#include "smp.h"
+#include "stats.h"
+#include "tsc.h"
+#include "vm.h"
+
+#define MAX_SPACES	4095
+#define WORKING_SET	32
+#define CR3_NOFLUSH	BIT_ULL(63)
+
+#define INVPCID_ADDR		0
+#define INVPCID_CONTEXT		1
+#define INVPCID_ALL_GLOBAL	2
+#define INVPCID_ALL		3
+
+struct invpcid_desc {
+	u64 pcid : 12;
+	u64 rsv  : 52;
+	u64 addr : 64;
+};
+
+static int nr_spaces = 16;
+static unsigned long nr_samples = 100000;
+static ulong *spaces;
+static u8 *working_set;
+
+/* Not the _safe() variants, their exception fixup would be measured too. */
+static inline void __write_cr3(ulong val)
+{
+	asm volatile ("mov %0, %%cr3" : : "r"(val) : "memory");
+}
+
+static inline void __invpcid(unsigned long type, struct invpcid_desc *desc)
+{
+	/* invpcid (%rax), %rbx */
+	asm volatile (".byte 0x66,0x0f,0x38,0x82,0x18"
+		      : : "a"(desc), "b"(type) : "memory");
+}
+
+static void touch_working_set(void)
+{
+	int i;
+
+	for (i = 0; i < WORKING_SET; ++i)
+		(void)*(volatile u8 *)(working_set + i * PAGE_SIZE);
+}
+
+static void *ws_page(unsigned long i)
+{
+	return working_set + (i % WORKING_SET) * PAGE_SIZE;
+}
+
+static void op_invlpg(unsigned long i)
+{
+	invlpg(ws_page(i));
+}
+
+static void op_invpcid_addr(unsigned long i)
+{
+	struct invpcid_desc desc = { .addr = (ulong)ws_page(i) };
+
+	__invpcid(INVPCID_ADDR, &desc);
+}
+
+static void op_invpcid_context(unsigned long i)
+{
+	struct invpcid_desc desc = { 0 };
+
+	__invpcid(INVPCID_CONTEXT, &desc);
+}
+
+static void op_invpcid_all_global(unsigned long i)
+{
+	struct invpcid_desc desc = { 0 };
+
+	__invpcid(INVPCID_ALL_GLOBAL, &desc);
+}
+
+static void op_invpcid_all(unsigned long i)
+{
+	struct invpcid_desc desc = { 0 };
+
+	__invpcid(INVPCID_ALL, &desc);
+}
+
+static void op_cr3(unsigned long i)
+{
+	__write_cr3(spaces[i % nr_spaces]);
+}
+
+static void op_cr3_touch(unsigned long i)
+{
+	op_cr3(i);
+	touch_working_set();
+}
+
+/* Address space n uses PCID n + 1, PCID 0 is the original one. */
+static void op_cr3_pcid(unsigned long i)
+{
+	int n = i % nr_spaces;
+
+	__write_cr3(spaces[n] | (n + 1));
+}
+
+static void op_cr3_pcid_touch(unsigned long i)
+{
+	op_cr3_pcid(i);
+	touch_working_set();
+}
+
+static void op_cr3_pcid_noflush(unsigned long i)
+{
+	int n = i % nr_spaces;
+
+	__write_cr3(spaces[n] | (n + 1) | CR3_NOFLUSH);
+}
+
+static void op_cr3_pcid_noflush_touch(unsigned long i)
+{
+	op_cr3_pcid_noflush(i);
+	touch_working_set();
+}
+
+static void measure(const char *op, bool per_space, void (*fn)(unsigned long))
+{
+	static struct stats_hist hist;
+	char name[64];
+	unsigned long i;
+	u64 start;
+
+	/* One round to fault in everything, e.g. shadow page tables. */
+	for (i = 0; i < nr_spaces; ++i)
+		fn(i);
+
+	stats_hist_init(&hist);
+	for (i = 0; i < nr_samples; ++i) {
+		start = rdtsc();
+		fn(i);
+		stats_hist_add(&hist, rdtsc() - start);
+	}
+
+	if (per_space)
+		snprintf(name, sizeof(name), "tlb.%s@%d", op, nr_spaces);
+	else
+		snprintf(name, sizeof(name), "tlb.%s", op);
+	tsc_hist_print(name, &hist);
+	tsc_hist_record(name, cpu_count(), &hist);
+	report_pass("%s", name);
+}
+
+int main(int ac, char **av)
+{
+	ulong cr3, cr4;
+	int i;
+
+	setup_vm();
+
+	if (ac > 1)
+		nr_spaces = atol(av[1]);
+	if (ac > 2)
+		nr_samples = atol(av[2]);
+	if (nr_spaces < 1 || nr_spaces > MAX_SPACES)
+		report_abort("invalid number of address spaces %d", nr_spaces);
+
+	cr3 = read_cr3();
+	cr4 = read_cr4();
+
+	spaces = calloc(nr_spaces, sizeof(*spaces));
+	assert(spaces);
+	for (i = 0; i < nr_spaces; ++i) {
+		pgd_t *root = alloc_page();
+
+		memcpy(root, current_page_table(), PAGE_SIZE);
+		spaces[i] = virt_to_phys(root);
+	}
+
+	working_set = alloc_pages(get_order(WORKING_SET));
+	touch_working_set();
+
+	printf("TSC frequency %" PRIu64 " kHz (%s)\n", tsc_hz() / 1000,
+	       tsc_hz_source());
+
+	measure("invlpg", false, op_invlpg);
+	measure("cr3", true, op_cr3);
+	measure("cr3+touch", true, op_cr3_touch);
+	write_cr3(cr3);
+
+	if (this_cpu_has(X86_FEATURE_PCID)) {
+		write_cr4(cr4 | X86_CR4_PCIDE);
+		measure("cr3_pcid", true, op_cr3_pcid);
+		measure("cr3_pcid+touch", true, op_cr3_pcid_touch);
+		measure("cr3_pcid_noflush", true, op_cr3_pcid_noflush);
+		measure("cr3_pcid_noflush+touch", true,
+			op_cr3_pcid_noflush_touch);
+		write_cr3(cr3);
+	} else {
+		report_skip("PCID not supported");
+	}
+
+	if (this_cpu_has(X86_FEATURE_INVPCID)) {
+		measure("invpcid_addr", false, op_invpcid_addr);
+		measure("invpcid_context", false, op_invpcid_context);
+		measure("invpcid_all_global", false, op_invpcid_all_global);
+		measure("invpcid_all", false, op_invpcid_all);
+	} else {
+		report_skip("INVPCID not supported");
+	}
+
+	write_cr4(cr4);
+
+	return report_summary();
+}
@@ -1,16 +1,27 @@
 /*
- * qemu command line | grep latency | cut -f 2 -d ":" > latency
+ * TSC deadline timer latency
  *
- * In octave:
- * load latency
- * min(latency)
- * max(latency)
- * mean(latency)
- * hist(latency, 50)
- */
-
-/*
- * for host tracing of breakmax option:
+ * Each interrupt re-arms the timer from the handler and records how late
+ * it arrived relative to the programmed deadline.  The deadlines follow
+ * one of several distributions, to exercise KVM's hrtimer handling and
+ * the lapic_timer_advance_ns tuning under different timer patterns:
+ *
+ * - fixed:   every deadline is delta cycles after the interrupt.
+ * - uniform: deadlines are uniformly distributed between delta/2 and
+ *            3*delta/2 after the interrupt.
+ * - bursty:  bursts of BURST_LEN deadlines delta/BURST_LEN apart,
+ *            separated by an idle period of BURST_LEN * delta.
+ *
+ * With "all", the test runs concurrently on every vCPU.  The latencies
+ * are summarized as percentiles per vCPU and for all vCPUs together.
+ * Interrupts that arrive before the deadline, which the advance timer
+ * must never cause, are counted separately and fail the test.
+ *
+ * Usage: tscdeadline_latency.flat [delta] [samples] [breakmax]
+ *                                 [fixed|uniform|bursty] [all]
+ *
+ * With breakmax, the test stops as soon as a latency exceeds breakmax
+ * cycles; for host tracing of that case:
  *
  * # cd /sys/kernel/debug/tracing/
  * # echo x86-tsc > trace_clock
@@ -21,12 +32,15 @@
  */
 
 #include "libcflat.h"
+#include "alloc.h"
 #include "apic.h"
 #include "vm.h"
 #include "smp.h"
 #include "desc.h"
 #include "isr.h"
 #include "msr.h"
+#include "stats.h"
+#include "tsc.h"
 
 static void test_lapic_existence(void)
 {
@@ -38,71 +52,139 @@ static void test_lapic_existence(void)
 }
 
 #define TSC_DEADLINE_TIMER_VECTOR 0xef
+#define BURST_LEN 8
+
+enum dist {
+    DIST_FIXED,
+    DIST_UNIFORM,
+    DIST_BURSTY,
+};
+
+static const char *dist_names[] = {
+    [DIST_FIXED] = "fixed",
+    [DIST_UNIFORM] = "uniform",
+    [DIST_BURSTY] = "bursty",
+};
+
+struct timer_cpu {
+    u64 exptime;
+    u64 rng;
+    long count;
+    unsigned long early;
+    u64 last_latency;
+    struct stats_hist hist;
+};
+
+/* Indexed by APIC ID, so that the interrupt handler can find its state. */
+static struct timer_cpu *timer_cpus[MAX_TEST_CPUS];
+
+static enum dist dist;
+static u64 delta;
+static long size;
+static u64 breakmax;
+static volatile int hitmax;
+
+/* xorshift64, seeded per vCPU. */
+static u64 next_random(struct timer_cpu *c)
+{
+    c->rng ^= c->rng << 13;
+    c->rng ^= c->rng >> 7;
+    c->rng ^= c->rng << 17;
+    return c->rng;
+}
 
-static int tdt_count;
-u64 exptime;
-int delta;
-#define TABLE_SIZE 10000
-u64 table[TABLE_SIZE];
-volatile int table_idx;
-volatile int hitmax = 0;
-int breakmax = 0;
+static u64 next_delta(struct timer_cpu *c)
+{
+    switch (dist) {
+    case DIST_UNIFORM:
+        return delta / 2 + next_random(c) % (delta + 1);
+    case DIST_BURSTY:
+        if (c->count % BURST_LEN)
+            return delta / BURST_LEN;
+        return delta * BURST_LEN;
+    default:
+        return delta;
+    }
+}
+
+static void arm(struct timer_cpu *c, u64 now)
+{
+    c->exptime = now + next_delta(c);
+    wrmsr(MSR_IA32_TSCDEADLINE, c->exptime);
+}
 
 static void tsc_deadline_timer_isr(isr_regs_t *regs)
 {
     u64 now = rdtsc();
-    ++tdt_count;
-
-    if (table_idx < TABLE_SIZE && tdt_count > 1)
-        table[table_idx++] = now - exptime;
-
-    if (breakmax && tdt_count > 1 && (now - exptime) > breakmax) {
-        hitmax = 1;
-        apic_write(APIC_EOI, 0);
-        return;
+    struct timer_cpu *c = timer_cpus[smp_id()];
+
+    /* The first deadline was armed outside the handler. */
+    if (c->count++) {
+        /* Early interrupts are counted, but are not latencies. */
+        if (now < c->exptime) {
+            c->early++;
+            c->last_latency = 0;
+        } else {
+            c->last_latency = now - c->exptime;
+            stats_hist_add(&c->hist, c->last_latency);
+        }
+
+        if (breakmax && c->last_latency > breakmax)
+            hitmax = 1;
     }
 
-    exptime = now+delta;
-    wrmsr(MSR_IA32_TSCDEADLINE, now+delta);
+    if (!hitmax && c->count <= size)
+        arm(c, now);
     apic_write(APIC_EOI, 0);
 }
 
-static void start_tsc_deadline_timer(void)
+static int enable_tsc_deadline_timer(void)
 {
-    handle_irq(TSC_DEADLINE_TIMER_VECTOR, tsc_deadline_timer_isr);
-    sti();
+    if (!this_cpu_has(X86_FEATURE_TSC_DEADLINE_TIMER))
+        return 0;
 
-    wrmsr(MSR_IA32_TSCDEADLINE, rdmsr(MSR_IA32_TSC)+delta);
-    asm volatile ("nop");
+    apic_write(APIC_LVTT, APIC_LVT_TIMER_TSCDEADLINE | TSC_DEADLINE_TIMER_VECTOR);
+    return 1;
 }
 
-static int enable_tsc_deadline_timer(void)
+/*
+ * Runs on every participating vCPU.  On APs it is called from the IPI
+ * handler, so interrupts are only enabled while halted.
+ */
+static void run_timer(void *data)
 {
-    uint32_t lvtt;
-
-    if (this_cpu_has(X86_FEATURE_TSC_DEADLINE_TIMER)) {
-        lvtt = APIC_LVT_TIMER_TSCDEADLINE | TSC_DEADLINE_TIMER_VECTOR;
-        apic_write(APIC_LVTT, lvtt);
-        start_tsc_deadline_timer();
-        return 1;
-    } else {
-        return 0;
+    struct timer_cpu *c = timer_cpus[smp_id()];
+
+    enable_tsc_deadline_timer();
+
+    cli();
+    arm(c, rdtsc());
+    while (!hitmax && c->count <= size) {
+        safe_halt();
+        cli();
     }
+    wrmsr(MSR_IA32_TSCDEADLINE, 0);
 }
 
-static void test_tsc_deadline_timer(void)
+static enum dist parse_dist(const char *name)
 {
-    if(enable_tsc_deadline_timer()) {
-        printf("tsc deadline timer enabled\n");
-    } else {
-        printf("tsc deadline timer not detected, aborting\n");
-        abort();
-    }
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(dist_names); i++)
+        if (!strcmp(name, dist_names[i]))
+            return i;
+
+    report_abort("unknown distribution '%s'", name);
+    return DIST_FIXED;
 }
 
 int main(int argc, char **argv)
 {
-    int i, size;
+    static struct stats_hist total;
+    unsigned long early = 0;
+    int cpu, nr_cpus = 1;
+    struct timer_cpu *c;
+    char name[64];
 
     setup_vm();
 
@@ -111,21 +193,59 @@ int main(int argc, char **argv)
     mask_pic_interrupts();
 
     delta = argc <= 1 ? 200000 : atol(argv[1]);
-    size = argc <= 2 ? TABLE_SIZE : atol(argv[2]);
+    size = argc <= 2 ? 10000 : atol(argv[2]);
     breakmax = argc <= 3 ? 0 : atol(argv[3]);
-    printf("breakmax=%d\n", breakmax);
-    test_tsc_deadline_timer();
-    sti();
+    dist = argc <= 4 ? DIST_FIXED : parse_dist(argv[4]);
+    if (argc > 5 && !strcmp(argv[5], "all"))
+        nr_cpus = cpu_count();
+    printf("breakmax=%" PRIu64 "\n", breakmax);
+
+    if (!enable_tsc_deadline_timer()) {
+        printf("tsc deadline timer not detected, aborting\n");
+        abort();
+    }
+    printf("tsc deadline timer enabled\n");
+    printf("TSC frequency %" PRIu64 " kHz (%s)\n", tsc_hz() / 1000,
+           tsc_hz_source());
+    printf("%s deadlines, delta %" PRIu64 ", %ld samples on %d vcpus\n",
+           dist_names[dist], delta, size, nr_cpus);
+
+    for (cpu = 0; cpu < nr_cpus; cpu++) {
+        c = calloc(1, sizeof(*c));
+        assert(c);
+        c->rng = 0x9e3779b97f4a7c15ull * (cpu + 1);
+        stats_hist_init(&c->hist);
+        timer_cpus[id_map[cpu]] = c;
+    }
+    handle_irq(TSC_DEADLINE_TIMER_VECTOR, tsc_deadline_timer_isr);
 
-    /* The condition might have triggered already, so check before HLT. */
-    while (!hitmax && table_idx < size)
-        asm volatile("hlt");
+    for (cpu = 1; cpu < nr_cpus; cpu++)
+        on_cpu_async(cpu, run_timer, NULL);
+    run_timer(NULL);
+    while (cpus_active() > 1)
+        pause();
+    sti();
 
-    for (i = 0; i < table_idx; i++) {
-        if (hitmax && i == table_idx-1)
-            printf("hit max: %d < ", breakmax);
-        printf("latency: %" PRId64 "\n", table[i]);
+    stats_hist_init(&total);
+    for (cpu = 0; cpu < nr_cpus; cpu++) {
+        c = timer_cpus[id_map[cpu]];
+        if (hitmax && breakmax && c->last_latency > breakmax)
+            printf("vcpu %d hit max: %" PRIu64 " < %" PRIu64 "\n",
+                   cpu, breakmax, c->last_latency);
+        if (nr_cpus > 1) {
+            snprintf(name, sizeof(name), "vcpu %d", cpu);
+            tsc_hist_print(name, &c->hist);
+        }
+        stats_hist_merge(&total, &c->hist);
+        early += c->early;
     }
 
+    snprintf(name, sizeof(name), "tscdeadline.%s@%d", dist_names[dist],
+             nr_cpus);
+    tsc_hist_print(name, &total);
+    tsc_hist_record(name, cpu_count(), &total);
+
+    report(!early, "no interrupts before the deadline (%lu early)", early);
+
     return report_summary();
 }
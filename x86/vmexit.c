@@ -1,11 +1,14 @@
 #include "libcflat.h"
 #include "acpi.h"
+#include "alloc.h"
+#include "stats.h"
 #include "smp.h"
 #include "pci.h"
 #include "x86/vm.h"
 #include "x86/desc.h"
 #include "x86/apic.h"
 #include "x86/isr.h"
+#include "x86/tsc.h"
 
 #define IPI_TEST_VECTOR	0xb0
 
@@ -15,19 +18,181 @@ struct test {
 	int (*valid)(void);
 	int parallel;
 	bool (*next)(struct test *);
+	/* Set by next() to tell apart the measurements of one entry. */
+	const char *label;
+	/* Exits per call of func; if set, the aggregate exit rate is printed. */
+	int batch;
 };
 
 #define GOAL (1ull << 30)
+#define WARMUP_GOAL (1ull << 24)
+#define WARMUP_MAX_ROUNDS 64
 
 static int nr_cpus;
 static u64 cr4_shadow;
 
+/*
+ * Number of vCPUs that run parallel tests, lowered by the "scaling" mode
+ * to sweep 1, 2, 4, ... nr_cpus concurrently exiting vCPUs.
+ */
+static int nr_active_cpus;
+static bool scaling;
+
+/*
+ * Per-iteration TSC deltas, kept per vCPU so that parallel tests and the
+ * IPI_TEST_VECTOR handler can record without any locking.  Indexed by
+ * APIC ID, which is what smp_id() returns.
+ */
+struct cpu_stats {
+	struct stats_hist exit;
+	struct stats_hist ipi;
+	struct stats_hist eoi;
+};
+
+static struct cpu_stats *cpu_stats;
+
+/*
+ * Histograms are only filled by a separate pass after the measurement,
+ * so that the mean printed as "<test> <cycles>" does not include the cost
+ * of recording them.
+ */
+static bool collect_hist;
+
+static struct cpu_stats *this_cpu_stats(void)
+{
+	return &cpu_stats[smp_id()];
+}
+
+static void record_sample(struct stats_hist *hist, u64 val)
+{
+	if (collect_hist)
+		stats_hist_add(hist, val);
+}
+
+static struct cpu_stats *cpu_stats_of(int cpu)
+{
+	return &cpu_stats[id_map[cpu]];
+}
+
 static void cpuid_test(void)
 {
 	asm volatile ("push %%"R "bx; cpuid; pop %%"R "bx"
 		      : : : "eax", "ecx", "edx");
 }
 
+/*
+ * Every standard, hypervisor and extended CPUID leaf up to the maximum
+ * reported for its range, with the subleaves that the leaf enumerates,
+ * plus the first leaf past each maximum.
+ */
+#define CPUID_SWEEP_MAX	512
+
+static struct {
+	int idx;
+	int nr;
+	u32 leaf[CPUID_SWEEP_MAX];
+	u32 subleaf[CPUID_SWEEP_MAX];
+	u32 eax, ecx;
+	char label[24];
+} cpuid_sweep;
+
+static void cpuid_sweep_test(void)
+{
+	u32 eax = cpuid_sweep.eax, ecx = cpuid_sweep.ecx;
+
+	asm volatile ("push %%"R "bx; cpuid; pop %%"R "bx"
+		      : "+a"(eax), "+c"(ecx) : : "edx");
+}
+
+static void cpuid_sweep_add(u32 leaf, u32 subleaf)
+{
+	if (cpuid_sweep.nr == CPUID_SWEEP_MAX)
+		return;
+
+	cpuid_sweep.leaf[cpuid_sweep.nr] = leaf;
+	cpuid_sweep.subleaf[cpuid_sweep.nr] = subleaf;
+	cpuid_sweep.nr++;
+}
+
+static void cpuid_sweep_add_leaf(u32 leaf)
+{
+	struct cpuid c = cpuid_indexed(leaf, 0);
+	u64 xfeatures;
+	u32 i;
+
+	switch (leaf) {
+	case 0x4:
+	case 0x8000001d:
+		/* Cache descriptors, until the null cache type. */
+		for (i = 0; i < 64 && (cpuid_indexed(leaf, i).a & 0x1f); i++)
+			cpuid_sweep_add(leaf, i);
+		break;
+	case 0x7:
+	case 0x14:
+	case 0x18:
+		/* EAX of subleaf 0 is the maximum subleaf. */
+		for (i = 0; i <= MIN(c.a, 63); i++)
+			cpuid_sweep_add(leaf, i);
+		break;
+	case 0xb:
+	case 0x1f:
+		/* Topology levels, until the invalid level type. */
+		for (i = 0; i < 64 && (cpuid_indexed(leaf, i).c & 0xff00); i++)
+			cpuid_sweep_add(leaf, i);
+		break;
+	case 0xd:
+		/* Subleaves 0 and 1, then one per supported XCR0/XSS feature. */
+		xfeatures = c.a | (u64)c.d << 32;
+		c = cpuid_indexed(leaf, 1);
+		xfeatures |= c.c | (u64)c.d << 32;
+		for (i = 0; i < 64; i++)
+			if (i < 2 || (xfeatures & BIT_ULL(i)))
+				cpuid_sweep_add(leaf, i);
+		break;
+	default:
+		cpuid_sweep_add(leaf, 0);
+		break;
+	}
+}
+
+static void cpuid_sweep_add_range(u32 base)
+{
+	u32 max = cpuid(base).a, leaf;
+
+	/* Ignore garbage if the range does not exist. */
+	if (max < base || max - base > 0xff)
+		max = base;
+
+	for (leaf = base; leaf <= max; leaf++)
+		cpuid_sweep_add_leaf(leaf);
+	cpuid_sweep_add(max + 1, 0);
+}
+
+static bool cpuid_sweep_next(struct test *test)
+{
+	if (!cpuid_sweep.nr) {
+		cpuid_sweep_add_range(0);
+		if (cpuid(1).c & (1u << 31))
+			cpuid_sweep_add_range(0x40000000);
+		cpuid_sweep_add_range(0x80000000);
+	}
+
+	if (cpuid_sweep.idx == cpuid_sweep.nr) {
+		cpuid_sweep.idx = 0;
+		return false;
+	}
+
+	cpuid_sweep.eax = cpuid_sweep.leaf[cpuid_sweep.idx];
+	cpuid_sweep.ecx = cpuid_sweep.subleaf[cpuid_sweep.idx];
+	cpuid_sweep.idx++;
+	snprintf(cpuid_sweep.label, sizeof(cpuid_sweep.label), "%08x.%x",
+		 cpuid_sweep.eax, cpuid_sweep.ecx);
+	test->label = cpuid_sweep.label;
+	test->func = cpuid_sweep_test;
+	printf("%s:", cpuid_sweep.label);
+	return true;
+}
+
 static void vmcall(void)
 {
 	unsigned long a = 0, b, c, d;
@@ -72,14 +237,18 @@ static void self_ipi_isr(isr_regs_t *regs)
 	x++;
 	uint64_t start = rdtsc();
 	eoi();
-	tsc_eoi += rdtsc() - start;
+	start = rdtsc() - start;
+	tsc_eoi += start;
+	record_sample(&this_cpu_stats()->eoi, start);
 }
 
 static void x2apic_self_ipi(int vec)
 {
 	uint64_t start = rdtsc();
 	wrmsr(0x83f, vec);
-	tsc_ipi += rdtsc() - start;
+	start = rdtsc() - start;
+	tsc_ipi += start;
+	record_sample(&this_cpu_stats()->ipi, start);
 }
 
 static void apic_self_ipi(int vec)
@@ -87,7 +256,9 @@ static void apic_self_ipi(int vec)
 	uint64_t start = rdtsc();
         apic_icr_write(APIC_INT_ASSERT | APIC_DEST_SELF | APIC_DEST_PHYSICAL |
 		       APIC_DM_FIXED | IPI_TEST_VECTOR, vec);
-	tsc_ipi += rdtsc() - start;
+	start = rdtsc() - start;
+	tsc_ipi += start;
+	record_sample(&this_cpu_stats()->ipi, start);
 }
 
 static void self_ipi_sti_nop(void)
@@ -189,7 +360,9 @@ static void ipi(void)
 {
 	uint64_t start = rdtsc();
 	on_cpu(1, nop, 0);
-	tsc_ipi += rdtsc() - start;
+	start = rdtsc() - start;
+	tsc_ipi += start;
+	record_sample(&this_cpu_stats()->ipi, start);
 }
 
 static void ipi_halt(void)
@@ -251,7 +424,7 @@ static void ple_round_robin(void)
 
 	p->n2 = p->n1;
 	you = me + 1;
-	if (you == nr_cpus)
+	if (you == nr_active_cpus)
 		you = 0;
 	++counters[you].n1;
 }
@@ -279,10 +452,26 @@ static struct pci_test {
 	int test_idx;
 	uint32_t data;
 	uint32_t offset;
+	char name[32];
+	/* State of the pci-mem-sweep and pci-io-sweep tests. */
+	int sweep_idx;
+	int width;
+	int batch;
+	char label[48];
 } pci_test = {
 	.test_idx = -1
 };
 
+/*
+ * Each pci-testdev test is swept over these access widths, first with
+ * a single write per iteration and then with PCI_BATCH back-to-back
+ * writes.  Only accesses of the width the device registered can match
+ * an ioeventfd, the others always exit to userspace.
+ */
+static const int pci_widths[] = { 1, 2, 4 };
+#define PCI_BATCH 16
+#define PCI_SWEEP_STEPS (2 * ARRAY_SIZE(pci_widths))
+
 static void pci_mem_testb(void)
 {
 	*(volatile uint8_t *)pci_test.mem = pci_test.data;
@@ -313,6 +502,44 @@ static void pci_io_testl(void)
 	outl(pci_test.data, pci_test.ioport);
 }
 
+static void pci_mem_sweep(void)
+{
+	int i;
+
+	for (i = 0; i < pci_test.batch; ++i) {
+		switch (pci_test.width) {
+		case 1:
+			*(volatile uint8_t *)pci_test.mem = pci_test.data;
+			break;
+		case 2:
+			*(volatile uint16_t *)pci_test.mem = pci_test.data;
+			break;
+		default:
+			*(volatile uint32_t *)pci_test.mem = pci_test.data;
+			break;
+		}
+	}
+}
+
+static void pci_io_sweep(void)
+{
+	int i;
+
+	for (i = 0; i < pci_test.batch; ++i) {
+		switch (pci_test.width) {
+		case 1:
+			outb(pci_test.data, pci_test.ioport);
+			break;
+		case 2:
+			outw(pci_test.data, pci_test.ioport);
+			break;
+		default:
+			outl(pci_test.data, pci_test.ioport);
+			break;
+		}
+	}
+}
+
 static uint8_t ioreadb(unsigned long addr, bool io)
 {
 	if (io) {
@@ -381,9 +608,14 @@ static bool pci_next(struct test *test, unsigned long addr, bool io)
 		if (!c) {
 			break;
 		}
-		printf("%c",c);
+		if (i < sizeof(pci_test.name) - 1)
+			pci_test.name[i] = c;
 	}
-	printf(":");
+	pci_test.name[MIN(i, sizeof(pci_test.name) - 1)] = '\0';
+	strcpy(pci_test.label, pci_test.name);
+	test->label = pci_test.label;
+	pci_test.mem = pci_test.memaddr + pci_test.offset;
+	pci_test.ioport = pci_test.iobar + pci_test.offset;
 	return true;
 }
 
@@ -391,8 +623,8 @@ static bool pci_mem_next(struct test *test)
 {
 	bool ret;
 	ret = pci_next(test, ((unsigned long)pci_test.memaddr), false);
-	if (ret) {
-		pci_test.mem = pci_test.memaddr + pci_test.offset;
+	if (ret && test->func) {
+		printf("%s:", pci_test.label);
 	}
 	return ret;
 }
@@ -401,12 +633,45 @@ static bool pci_io_next(struct test *test)
 {
 	bool ret;
 	ret = pci_next(test, ((unsigned long)pci_test.iobar), true);
-	if (ret) {
-		pci_test.ioport = pci_test.iobar + pci_test.offset;
+	if (ret && test->func) {
+		printf("%s:", pci_test.label);
 	}
 	return ret;
 }
 
+static bool pci_sweep_next(struct test *test, bool io)
+{
+	unsigned long addr = io ? pci_test.iobar :
+				  (unsigned long)pci_test.memaddr;
+
+	if (pci_test.test_idx < 0 || ++pci_test.sweep_idx == PCI_SWEEP_STEPS) {
+		pci_test.sweep_idx = 0;
+		if (!pci_next(test, addr, io))
+			return false;
+		if (!test->func)
+			return true;
+	}
+
+	pci_test.width = pci_widths[pci_test.sweep_idx % ARRAY_SIZE(pci_widths)];
+	pci_test.batch = pci_test.sweep_idx < ARRAY_SIZE(pci_widths) ? 1 : PCI_BATCH;
+	test->func = io ? pci_io_sweep : pci_mem_sweep;
+	test->batch = pci_test.batch;
+	snprintf(pci_test.label, sizeof(pci_test.label), "%s.w%d.x%d",
+		 pci_test.name, pci_test.width, pci_test.batch);
+	printf("%s:", pci_test.label);
+	return true;
+}
+
+static bool pci_mem_sweep_next(struct test *test)
+{
+	return pci_sweep_next(test, false);
+}
+
+static bool pci_io_sweep_next(struct test *test)
+{
+	return pci_sweep_next(test, true);
+}
+
 static int has_tscdeadline(void)
 {
     uint32_t lvtt;
@@ -478,8 +743,112 @@ static void toggle_cr4_pge(void)
 	write_cr4(cr4_shadow);
 }
 
+/*
+ * Instructions run through KVM's emulator with the forced emulation
+ * prefix.  fep_nop measures the #UD intercept and the decode of the
+ * prefix; the cost of emulating the other instructions is their
+ * difference from it.
+ */
+static int has_fep(void)
+{
+	return is_fep_available();
+}
+
+static void fep_nop(void)
+{
+	asm volatile (KVM_FEP "nop");
+}
+
+static void fep_add_reg(void)
+{
+	unsigned long a = 1, b = 2;
+
+	asm volatile (KVM_FEP "add %1, %0" : "+r"(a) : "r"(b));
+}
+
+static void fep_add_mem(void)
+{
+	unsigned long mem = 0;
+
+	asm volatile (KVM_FEP "add %1, %0" : "+m"(mem) : "r"(1ul));
+}
+
+static void fep_push_pop(void)
+{
+	unsigned long a = 0;
+
+	asm volatile (KVM_FEP "push %0\n\t"
+		      KVM_FEP "pop %0" : "+r"(a) : : "memory");
+}
+
+static void fep_movs(void)
+{
+	u8 src = 0, dst;
+	u8 *s = &src, *d = &dst;
+
+	asm volatile (KVM_FEP "movsb" : "+S"(s), "+D"(d) : : "memory");
+}
+
+static void fep_rep_movs(void)
+{
+	u8 src[64] = { 0 }, dst[64];
+	u8 *s = src, *d = dst;
+	unsigned long n = sizeof(src);
+
+	asm volatile (KVM_FEP "rep movsb"
+		      : "+S"(s), "+D"(d), "+c"(n) : : "memory");
+}
+
+static void fep_mov_from_cr0(void)
+{
+	unsigned long cr0;
+
+	asm volatile (KVM_FEP "mov %%cr0, %0" : "=r"(cr0));
+}
+
+static void fep_mov_to_cr0(void)
+{
+	asm volatile (KVM_FEP "mov %0, %%cr0" : : "r"(read_cr0()));
+}
+
+static void fep_mov_to_dr7(void)
+{
+	asm volatile (KVM_FEP "mov %0, %%dr7" : : "r"(0x400L));
+}
+
+static void fep_ljmp(void)
+{
+	struct {
+		unsigned long offset;
+		u16 selector;
+	} __attribute__((packed)) fp;
+	unsigned long tmp;
+
+#ifdef __x86_64__
+	asm volatile ("lea 1f(%%rip), %1\n\t"
+		      "mov %1, %0\n\t"
+		      "movw %%cs, 8+%0\n\t"
+		      KVM_FEP "rex64 ljmp *%0\n\t"
+		      "1:" : "=m"(fp), "=&r"(tmp));
+#else
+	asm volatile ("movl $1f, %1\n\t"
+		      "mov %1, %0\n\t"
+		      "movw %%cs, 4+%0\n\t"
+		      KVM_FEP "ljmp *%0\n\t"
+		      "1:" : "=m"(fp), "=&r"(tmp));
+#endif
+}
+
+static void fep_movaps(void)
+{
+	u8 mem[16] __attribute__((aligned(16)));
+
+	asm volatile (KVM_FEP "movaps %%xmm0, %0" : "=m"(mem) : : "memory");
+}
+
 static struct test tests[] = {
 	{ cpuid_test, "cpuid", .parallel = 1,  },
+	{ NULL, "cpuid-sweep", .parallel = 1, .next = cpuid_sweep_next },
 	{ vmcall, "vmcall", .parallel = 1, },
 #ifdef __x86_64__
 	{ mov_from_cr8, "mov_from_cr8", .parallel = 1, },
@@ -513,30 +882,245 @@ static struct test tests[] = {
 	{ rd_tsc_adjust_msr, "rd_tsc_adjust_msr", .parallel = 1 },
 	{ toggle_cr0_wp, "toggle_cr0_wp" , .parallel = 1, },
 	{ toggle_cr4_pge, "toggle_cr4_pge" , .parallel = 1, },
+	{ fep_nop, "fep_nop", has_fep, .parallel = 1, },
+	{ fep_add_reg, "fep_add_reg", has_fep, .parallel = 1, },
+	{ fep_add_mem, "fep_add_mem", has_fep, .parallel = 1, },
+	{ fep_push_pop, "fep_push_pop", has_fep, .parallel = 1, },
+	{ fep_movs, "fep_movs", has_fep, .parallel = 1, },
+	{ fep_rep_movs, "fep_rep_movs", has_fep, .parallel = 1, },
+	{ fep_mov_from_cr0, "fep_mov_from_cr0", has_fep, .parallel = 1, },
+	{ fep_mov_to_cr0, "fep_mov_to_cr0", has_fep, .parallel = 1, },
+	{ fep_mov_to_dr7, "fep_mov_to_dr7", has_fep, .parallel = 1, },
+	{ fep_ljmp, "fep_ljmp", has_fep, .parallel = 1, },
+	{ fep_movaps, "fep_movaps", has_fep, .parallel = 1, },
 	{ NULL, "pci-mem", .parallel = 0, .next = pci_mem_next },
 	{ NULL, "pci-io", .parallel = 0, .next = pci_io_next },
+	{ NULL, "pci-mem-sweep", .parallel = 1, .next = pci_mem_sweep_next },
+	{ NULL, "pci-io-sweep", .parallel = 1, .next = pci_io_sweep_next },
 };
 
 unsigned iterations;
 
 static void run_test(void *_func)
 {
-    int i;
-    void (*func)(void) = _func;
+	struct stats_hist *hist = &this_cpu_stats()->exit;
+	void (*func)(void) = _func;
+	u64 start;
+	int i;
+
+	if (!collect_hist) {
+		for (i = 0; i < iterations; ++i)
+			func();
+		return;
+	}
+
+	for (i = 0; i < iterations; ++i) {
+		start = rdtsc();
+		func();
+		stats_hist_add(hist, rdtsc() - start);
+	}
+}
+
+static void run_on_active_cpus(void (*func)(void *data), void *data)
+{
+	int cpu;
+
+	for (cpu = nr_active_cpus - 1; cpu >= 0; --cpu)
+		on_cpu_async(cpu, func, data);
 
-    for (i = 0; i < iterations; ++i)
-        func();
+	while (cpus_active() > 1)
+		pause();
 }
 
-static bool do_test(struct test *test)
+static void reset_stats(void)
+{
+	int i;
+
+	for (i = 0; i < nr_cpus; ++i) {
+		stats_hist_init(&cpu_stats_of(i)->exit);
+		stats_hist_init(&cpu_stats_of(i)->ipi);
+		stats_hist_init(&cpu_stats_of(i)->eoi);
+	}
+}
+
+static void record_stats(const char *name, struct cpu_stats *stats)
 {
+	char buf[80];
+
+	tsc_hist_record(name, nr_cpus, &stats->exit);
+	snprintf(buf, sizeof(buf), "%s.ipi", name);
+	tsc_hist_record(buf, nr_cpus, &stats->ipi);
+	snprintf(buf, sizeof(buf), "%s.eoi", name);
+	tsc_hist_record(buf, nr_cpus, &stats->eoi);
+}
+
+/* E.g. pci-testdev runs several device tests under the same entry. */
+static void test_label(struct test *test, char *buf, size_t size)
+{
+	if (test->label)
+		snprintf(buf, size, "%s.%s", test->name, test->label);
+	else
+		snprintf(buf, size, "%s", test->name);
+}
+
+/*
+ * Print the aggregate exit rate of the vCPUs that ran the last batch,
+ * per million TSC cycles if the TSC frequency is not known.
+ */
+static void print_rate(struct test *test, unsigned long long elapsed)
+{
+	u64 exits = (u64)iterations * (test->batch ? test->batch : 1);
+
+	if (test->parallel)
+		exits *= nr_active_cpus;
+
+	if (tsc_hz())
+		printf(" exits/s %" PRIu64 "\n",
+		       exits * (tsc_hz() / 1000) / (u64)(elapsed / 1000));
+	else
+		printf(" exits/Mcycle %d\n", (int)(1000000ull * exits / elapsed));
+}
+
+static void print_stats(struct test *test)
+{
+	static struct cpu_stats total;
+	char name[64];
 	int i;
+
+	stats_hist_init(&total.exit);
+	stats_hist_init(&total.ipi);
+	stats_hist_init(&total.eoi);
+	for (i = 0; i < nr_cpus; ++i) {
+		stats_hist_merge(&total.exit, &cpu_stats_of(i)->exit);
+		stats_hist_merge(&total.ipi, &cpu_stats_of(i)->ipi);
+		stats_hist_merge(&total.eoi, &cpu_stats_of(i)->eoi);
+	}
+
+	snprintf(name, sizeof(name), "  %s", test->name);
+	tsc_hist_print(name, &total.exit);
+	snprintf(name, sizeof(name), "  ipi %s", test->name);
+	tsc_hist_print(name, &total.ipi);
+	snprintf(name, sizeof(name), "  eoi %s", test->name);
+	tsc_hist_print(name, &total.eoi);
+
+	test_label(test, name, sizeof(name));
+	record_stats(name, &total);
+}
+
+static unsigned long long run_batch(struct test *test, void (*func)(void))
+{
 	unsigned long long t1, t2;
-        void (*func)(void);
 
-        iterations = 32;
+	tsc_eoi = tsc_ipi = 0;
+	reset_stats();
+	t1 = rdtsc();
+
+	if (!test->parallel) {
+		run_test(func);
+	} else {
+		run_on_active_cpus(run_test, func);
+	}
+	t2 = rdtsc();
+
+	return t2 - t1;
+}
+
+/*
+ * Run batches of at least WARMUP_GOAL cycles until two consecutive ones
+ * agree on the cost of an iteration within 2%, so that cold caches and
+ * lazy setup in the host do not skew the measurement.
+ */
+static void warm_up(struct test *test, void (*func)(void))
+{
+	unsigned long long elapsed, cost, prev = 0;
+	int round;
+
+	iterations = 64;
+	for (round = 0; round < WARMUP_MAX_ROUNDS; ++round) {
+		elapsed = run_batch(test, func);
+		if (elapsed < WARMUP_GOAL) {
+			iterations *= 2;
+			continue;
+		}
+
+		cost = elapsed / iterations;
+		if (prev && cost * 50 >= prev * 49 && cost * 50 <= prev * 51)
+			return;
+		prev = cost;
+	}
+	printf("%s: warm-up did not converge\n", test->name);
+}
+
+static unsigned long long measure(struct test *test, void (*func)(void))
+{
+	unsigned long long elapsed;
+	u64 ipi, eoi;
+
+	warm_up(test, func);
+
+	iterations = 32;
+	do {
+		iterations *= 2;
+		elapsed = run_batch(test, func);
+	} while (elapsed < GOAL);
+
+	/* Fill the histograms, keeping the ipi and eoi sums of the above. */
+	ipi = tsc_ipi;
+	eoi = tsc_eoi;
+	collect_hist = true;
+	run_batch(test, func);
+	collect_hist = false;
+	tsc_ipi = ipi;
+	tsc_eoi = eoi;
+
+	return elapsed;
+}
+
+/*
+ * Run a parallel test on 1, 2, 4, ... nr_cpus vCPUs, and report the cost
+ * of an exit as seen by each vCPU and the aggregate exit rate of all of
+ * them.
+ */
+static void do_scaling_test(struct test *test, void (*func)(void))
+{
+	static struct stats_hist total;
+	unsigned long long elapsed;
+	char label[64], name[80];
+	int i;
+
+	test_label(test, label, sizeof(label));
+
+	for (nr_active_cpus = 1; ; nr_active_cpus *= 2) {
+		nr_active_cpus = MIN(nr_active_cpus, nr_cpus);
+		elapsed = measure(test, func);
+
+		stats_hist_init(&total);
+		for (i = 0; i < nr_active_cpus; ++i)
+			stats_hist_merge(&total, &cpu_stats_of(i)->exit);
+
+		printf("%s cpus %d per-cpu %d cycles", test->name,
+		       nr_active_cpus, (int)(elapsed / iterations));
+		if (tsc_hz())
+			printf(" %d ns", (int)tsc_to_ns(elapsed / iterations));
+		print_rate(test, elapsed);
+		snprintf(name, sizeof(name), "  %s cpus %d", test->name,
+			 nr_active_cpus);
+		tsc_hist_print(name, &total);
+		snprintf(name, sizeof(name), "%s@%d", label, nr_active_cpus);
+		tsc_hist_record(name, nr_cpus, &total);
+
+		if (nr_active_cpus == nr_cpus)
+			break;
+	}
+	nr_active_cpus = nr_cpus;
+}
+
+static bool do_test(struct test *test)
+{
+	unsigned long long elapsed;
+	void (*func)(void);
 
-        if (test->valid && !test->valid()) {
+	if (test->valid && !test->valid()) {
 		printf("%s (skipped)\n", test->name);
 		return false;
 	}
@@ -551,24 +1135,22 @@ static bool do_test(struct test *test)
 		return false;
 	}
 
-	do {
-		tsc_eoi = tsc_ipi = 0;
-		iterations *= 2;
-		t1 = rdtsc();
+	if (scaling && test->parallel) {
+		do_scaling_test(test, func);
+		return test->next;
+	}
 
-		if (!test->parallel) {
-			for (i = 0; i < iterations; ++i)
-				func();
-		} else {
-			on_cpus(run_test, func);
-		}
-		t2 = rdtsc();
-	} while ((t2 - t1) < GOAL);
-	printf("%s %d\n", test->name, (int)((t2 - t1) / iterations));
+	elapsed = measure(test, func);
+	printf("%s %d\n", test->name, (int)(elapsed / iterations));
+	if (test->batch) {
+		printf("  %s", test->name);
+		print_rate(test, elapsed);
+	}
 	if (tsc_ipi)
 		printf("  ipi %s %d\n", test->name, (int)(tsc_ipi / iterations));
 	if (tsc_eoi)
 		printf("  eoi %s %d\n", test->name, (int)(tsc_eoi / iterations));
+	print_stats(test);
 
 	return test->next;
 }
@@ -579,6 +1161,13 @@ static void enable_nx(void *junk)
 		wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NX_MASK);
 }
 
+/* For fep_movaps, SSE instructions #UD unless the OS enables them. */
+static void enable_sse(void *junk)
+{
+	write_cr0(read_cr0() & ~(X86_CR0_EM | X86_CR0_TS));
+	write_cr4(read_cr4() | X86_CR4_OSFXSR);
+}
+
 static bool test_wanted(struct test *test, char *wanted[], int nwanted)
 {
 	int i;
@@ -598,15 +1187,21 @@ int main(int ac, char **av)
 	int i;
 	unsigned long membar = 0;
 	struct pci_dev pcidev;
+	int max_apic_id = 0;
 	int ret;
 
 	setup_vm();
-	cr4_shadow = read_cr4();
 	handle_irq(IPI_TEST_VECTOR, self_ipi_isr);
 	nr_cpus = cpu_count();
+	for (i = 0; i < nr_cpus; ++i)
+		max_apic_id = MAX(max_apic_id, id_map[i]);
+	cpu_stats = calloc(max_apic_id + 1, sizeof(*cpu_stats));
+	assert(cpu_stats);
 
 	sti();
 	on_cpus(enable_nx, NULL);
+	on_cpus(enable_sse, NULL);
+	cr4_shadow = read_cr4();
 
 	ret = pci_find_dev(PCI_VENDOR_ID_REDHAT, PCI_DEVICE_ID_REDHAT_TEST);
 	if (ret != PCIDEVADDR_INVALID) {
@@ -620,6 +1215,16 @@ int main(int ac, char **av)
 		       pcidev.bdf, membar, pci_test.iobar);
 	}
 
+	printf("TSC frequency %" PRIu64 " kHz (%s)\n", tsc_hz() / 1000,
+	       tsc_hz_source());
+
+	nr_active_cpus = nr_cpus;
+	if (ac > 1 && strcmp(av[1], "scaling") == 0) {
+		scaling = true;
+		av++;
+		ac--;
+	}
+
 	for (i = 0; i < ARRAY_SIZE(tests); ++i)
 		if (test_wanted(&tests[i], av + 1, ac - 1))
 			while (do_test(&tests[i])) {}
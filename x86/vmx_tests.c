@@ -21,6 +21,8 @@
 #include "smp.h"
 #include "delay.h"
 #include "access.h"
+#include "stats.h"
+#include "tsc.h"
 #include "x86/usermode.h"
 
 /*
@@ -10205,6 +10207,243 @@ static void vmx_vmcs_shadow_test(void)
 	enter_guest();
 }
 
+/*
+ * Per-field VMREAD/VMWRITE cost.  In L1, an access is cheap if L0 exposes
+ * the field in its own shadow VMCS bitmaps and traps to L0 otherwise, so
+ * the fields are classified against the cost of a CPUID exit.  L0 only
+ * uses VMCS shadowing if the host enables it (kvm_intel.enable_shadow_vmcs).
+ * In L2, with the same setup as vmx_vmcs_shadow_test, each access is then
+ * measured once shadowed by L1's shadow VMCS and once exiting to L1.
+ */
+#define VMCS_PERF_ITERS		256
+
+static struct vmcs_perf_common {
+	enum vmcs_access op;
+	u64 field;
+	struct stats_hist hist;
+} vmcs_perf;
+
+struct vmcs_perf_totals {
+	const char *name;
+	struct stats_hist hist;
+};
+
+enum {
+	VMCS_PERF_L1_VMREAD,
+	VMCS_PERF_L1_VMWRITE,
+	VMCS_PERF_L2_VMREAD_SHADOW,
+	VMCS_PERF_L2_VMREAD_EXIT,
+	VMCS_PERF_L2_VMWRITE_SHADOW,
+	VMCS_PERF_L2_VMWRITE_EXIT,
+	NR_VMCS_PERF,
+};
+
+static struct vmcs_perf_totals vmcs_perf_totals[NR_VMCS_PERF] = {
+	[VMCS_PERF_L1_VMREAD] = { "vmcs.l1_vmread" },
+	[VMCS_PERF_L1_VMWRITE] = { "vmcs.l1_vmwrite" },
+	[VMCS_PERF_L2_VMREAD_SHADOW] = { "vmcs.l2_vmread.shadow" },
+	[VMCS_PERF_L2_VMREAD_EXIT] = { "vmcs.l2_vmread.exit" },
+	[VMCS_PERF_L2_VMWRITE_SHADOW] = { "vmcs.l2_vmwrite.shadow" },
+	[VMCS_PERF_L2_VMWRITE_EXIT] = { "vmcs.l2_vmwrite.exit" },
+};
+
+static void vmcs_perf_access(struct stats_hist *h, enum vmcs_access op,
+			     u64 field, u64 value)
+{
+	u64 start;
+	int i;
+
+	for (i = 0; i < VMCS_PERF_ITERS; i++) {
+		start = rdtsc();
+		if (op == ACCESS_VMREAD)
+			vmread_flags(field, &value);
+		else
+			vmwrite_flags(field, value);
+		stats_hist_add(h, rdtsc() - start);
+	}
+}
+
+static void vmx_vmcs_shadow_perf_guest(void)
+{
+	struct vmcs_perf_common *c = &vmcs_perf;
+
+	while (c->op != ACCESS_NONE) {
+		vmcs_perf_access(&c->hist, c->op, c->field, 0);
+		vmcall();
+	}
+}
+
+static u64 vmcs_perf_add(int type, struct stats_hist *h)
+{
+	stats_hist_merge(&vmcs_perf_totals[type].hist, h);
+	return stats_hist_percentile(h, 500);
+}
+
+/* Write back the value that was read, the VMCS is only a scratch one. */
+static u64 vmcs_perf_l1(struct vmcs *scratch, u64 field, enum vmcs_access op)
+{
+	static struct stats_hist h;
+	struct vmcs *primary;
+	u64 value;
+
+	TEST_ASSERT(!vmcs_save(&primary));
+	TEST_ASSERT(!make_vmcs_current(scratch));
+	vmcs_read_safe(field, &value);
+	stats_hist_init(&h);
+	vmcs_perf_access(&h, op, field, value);
+	TEST_ASSERT(!make_vmcs_current(primary));
+
+	return vmcs_perf_add(op == ACCESS_VMREAD ? VMCS_PERF_L1_VMREAD :
+			     VMCS_PERF_L1_VMWRITE, &h);
+}
+
+static u64 vmcs_perf_l2(u8 *bitmap[2], u64 field, enum vmcs_access op,
+			bool shadowed)
+{
+	struct vmcs_perf_common *c = &vmcs_perf;
+	u32 reason;
+	int type;
+
+	if (shadowed)
+		clear_bit(field, bitmap[op]);
+	else
+		set_bit(field, bitmap[op]);
+
+	c->op = op;
+	c->field = field;
+	stats_hist_init(&c->hist);
+
+	for (;;) {
+		enter_guest();
+		reason = vmcs_read(EXI_REASON) & 0xffff;
+		if (reason == VMX_VMCALL)
+			break;
+		TEST_ASSERT_EQ(reason, op == ACCESS_VMREAD ? VMX_VMREAD :
+						VMX_VMWRITE);
+		skip_exit_insn();
+	}
+	skip_exit_vmcall();
+
+	if (op == ACCESS_VMREAD)
+		type = shadowed ? VMCS_PERF_L2_VMREAD_SHADOW :
+				  VMCS_PERF_L2_VMREAD_EXIT;
+	else
+		type = shadowed ? VMCS_PERF_L2_VMWRITE_SHADOW :
+				  VMCS_PERF_L2_VMWRITE_EXIT;
+	return vmcs_perf_add(type, &c->hist);
+}
+
+static void vmx_vmcs_shadow_perf_test(void)
+{
+	static struct stats_hist cpuid_hist;
+	unsigned int width, type, index, max_index;
+	unsigned int fields = 0, read_traps = 0, write_traps = 0;
+	u64 field, value, start, l1_read, l1_write, threshold;
+	struct vmcs *shadow, *scratch;
+	u8 *bitmap[2];
+	int i;
+
+	if (!(ctrl_cpu_rev[0].clr & CPU_SECONDARY))
+		test_skip("\"Activate secondary controls\" not supported");
+	if (!(ctrl_cpu_rev[1].clr & CPU_SHADOW_VMCS))
+		test_skip("\"VMCS shadowing\" not supported");
+
+	test_set_guest(vmx_vmcs_shadow_perf_guest);
+
+	bitmap[ACCESS_VMREAD] = alloc_page();
+	bitmap[ACCESS_VMWRITE] = alloc_page();
+	vmcs_write(VMREAD_BITMAP, virt_to_phys(bitmap[ACCESS_VMREAD]));
+	vmcs_write(VMWRITE_BITMAP, virt_to_phys(bitmap[ACCESS_VMWRITE]));
+
+	shadow = alloc_page();
+	shadow->hdr.revision_id = basic.revision;
+	shadow->hdr.shadow_vmcs = 1;
+	TEST_ASSERT(!vmcs_clear(shadow));
+
+	scratch = alloc_page();
+	scratch->hdr.revision_id = basic.revision;
+	TEST_ASSERT(!vmcs_clear(scratch));
+
+	vmcs_clear_bits(CPU_EXEC_CTRL0, CPU_RDTSC);
+	vmcs_set_bits(CPU_EXEC_CTRL0, CPU_SECONDARY);
+	vmcs_set_bits(CPU_EXEC_CTRL1, CPU_SHADOW_VMCS);
+	vmcs_write(VMCS_LINK_PTR, virt_to_phys(shadow));
+
+	for (i = 0; i < NR_VMCS_PERF; i++)
+		stats_hist_init(&vmcs_perf_totals[i].hist);
+
+	/* A field access that costs more than half an exit traps to L0. */
+	stats_hist_init(&cpuid_hist);
+	for (i = 0; i < VMCS_PERF_ITERS; i++) {
+		start = rdtsc();
+		raw_cpuid(0, 0);
+		stats_hist_add(&cpuid_hist, rdtsc() - start);
+	}
+	threshold = stats_hist_percentile(&cpuid_hist, 500) / 2;
+
+	printf("TSC frequency %" PRIu64 " kHz (%s)\n", tsc_hz() / 1000,
+	       tsc_hz_source());
+	printf("CPUID p50 %" PRIu64 " cycles, L1 accesses above %" PRIu64
+	       " cycles trap to L0\n", threshold * 2, threshold);
+	printf("p50 cycles:   L1 vmread    vmwrite   L2 vmread shadow/exit"
+	       "   vmwrite shadow/exit\n");
+
+	max_index = (rdmsr(MSR_IA32_VMX_VMCS_ENUM) & VMCS_FIELD_INDEX_MASK) >>
+		    VMCS_FIELD_INDEX_SHIFT;
+
+	/* Skip the encodings of the high half of 64-bit fields (bit 0). */
+	for (width = 0; width < 4; width++) {
+		for (type = 0; type < 4; type++) {
+			for (index = 0; index <= max_index; index++) {
+				field = (width << VMCS_FIELD_WIDTH_SHIFT) |
+					(type << VMCS_FIELD_TYPE_SHIFT) |
+					(index << VMCS_FIELD_INDEX_SHIFT);
+				if (vmcs_read_safe(field, &value) &
+				    (X86_EFLAGS_CF | X86_EFLAGS_ZF))
+					continue;
+
+				fields++;
+				l1_read = vmcs_perf_l1(scratch, field,
+						       ACCESS_VMREAD);
+				l1_write = vmcs_perf_l1(scratch, field,
+							ACCESS_VMWRITE);
+				read_traps += l1_read > threshold;
+				write_traps += l1_write > threshold;
+
+				printf("field %05lx: %9" PRIu64 "%c %9" PRIu64
+				       "%c   %9" PRIu64 " / %-9" PRIu64,
+				       field, l1_read,
+				       l1_read > threshold ? '*' : ' ',
+				       l1_write,
+				       l1_write > threshold ? '*' : ' ',
+				       vmcs_perf_l2(bitmap, field,
+						    ACCESS_VMREAD, true),
+				       vmcs_perf_l2(bitmap, field,
+						    ACCESS_VMREAD, false));
+				printf("   %9" PRIu64 " / %" PRIu64 "\n",
+				       vmcs_perf_l2(bitmap, field,
+						    ACCESS_VMWRITE, true),
+				       vmcs_perf_l2(bitmap, field,
+						    ACCESS_VMWRITE, false));
+			}
+		}
+	}
+	printf("(* = traps to L0)\n");
+
+	for (i = 0; i < NR_VMCS_PERF; i++) {
+		tsc_hist_print(vmcs_perf_totals[i].name,
+			       &vmcs_perf_totals[i].hist);
+		tsc_hist_record(vmcs_perf_totals[i].name, cpu_count(),
+				&vmcs_perf_totals[i].hist);
+	}
+
+	report(fields, "%u fields, %u trap to L0 on VMREAD and %u on VMWRITE",
+	       fields, read_traps, write_traps);
+
+	vmcs_perf.op = ACCESS_NONE;
+	enter_guest();
+}
+
 /*
  * This test monitors the difference between a guest RDTSC instruction
  * and the IA32_TIME_STAMP_COUNTER MSR value stored in the VMCS12
@@ -10611,6 +10850,336 @@ static void vmx_pf_vpid_test(void)
 	__vmx_pf_vpid_test(invalidate_tlb_new_vpid, 1);
 }
 
+/*
+ * Nested round-trip latency: L2 times each exiting instruction with RDTSC,
+ * so a sample is the full L2 -> L0 -> L1 -> L0 -> L2 path, including the
+ * VMREADs and VMWRITEs of the L1 exit handler below.  Whether those exit
+ * to L0 depends on the host's VMCS shadowing (kvm_intel.enable_shadow_vmcs),
+ * which L1 cannot change; compare runs with the module parameter on and off.
+ */
+#define VMX_RT_WARMUP		100
+#define VMX_RT_SAMPLES		10000
+#define VMX_RT_MSR		MSR_IA32_SYSENTER_CS
+#define VMX_RT_PORT		0x80
+
+enum {
+	VMX_RT_VMCALL,
+	VMX_RT_CPUID,
+	VMX_RT_RDMSR,
+	VMX_RT_IO,
+	VMX_RT_EPT,
+	NR_VMX_RT_OPS,
+};
+
+static const char *vmx_rt_names[NR_VMX_RT_OPS] = {
+	[VMX_RT_VMCALL] = "vmcall",
+	[VMX_RT_CPUID] = "cpuid",
+	[VMX_RT_RDMSR] = "rdmsr",
+	[VMX_RT_IO] = "io",
+	[VMX_RT_EPT] = "ept_violation",
+};
+
+static struct stats_hist vmx_rt_hist[NR_VMX_RT_OPS];
+static u32 *vmx_rt_ro_page;
+static volatile bool vmx_rt_done;
+
+static void vmx_rt_op(int op)
+{
+	switch (op) {
+	case VMX_RT_VMCALL:
+		vmcall();
+		break;
+	case VMX_RT_CPUID:
+		raw_cpuid(0, 0);
+		break;
+	case VMX_RT_RDMSR:
+		rdmsr(VMX_RT_MSR);
+		break;
+	case VMX_RT_IO:
+		inb(VMX_RT_PORT);
+		break;
+	case VMX_RT_EPT:
+		/* Two bytes, L1 skips it by hand: no instruction length here. */
+		asm volatile("mov %%eax, (%%rbx)"
+			     : : "a"(0), "b"(vmx_rt_ro_page) : "memory");
+		break;
+	}
+}
+
+static void vmx_rt_guest(void)
+{
+	unsigned long i;
+	u64 start;
+	int op;
+
+	for (op = 0; op < NR_VMX_RT_OPS; op++) {
+		if (op == VMX_RT_EPT && !vmx_rt_ro_page)
+			continue;
+
+		for (i = 0; i < VMX_RT_WARMUP + VMX_RT_SAMPLES; i++) {
+			start = rdtsc();
+			vmx_rt_op(op);
+			if (i >= VMX_RT_WARMUP)
+				stats_hist_add(&vmx_rt_hist[op], rdtsc() - start);
+		}
+	}
+	vmx_rt_done = true;
+}
+
+static void vmx_rt_handle_exit(void)
+{
+	u32 reason = vmcs_read(EXI_REASON);
+	struct cpuid cpuid;
+
+	switch (reason) {
+	case VMX_VMCALL:
+		break;
+	case VMX_CPUID:
+		cpuid = raw_cpuid(regs.rax, regs.rcx);
+		regs.rax = cpuid.a;
+		regs.rbx = cpuid.b;
+		regs.rcx = cpuid.c;
+		regs.rdx = cpuid.d;
+		break;
+	case VMX_RDMSR:
+		assert(regs.rcx == VMX_RT_MSR);
+		regs.rax = 0;
+		regs.rdx = 0;
+		break;
+	case VMX_IO:
+		regs.rax |= 0xff;
+		break;
+	case VMX_EPT_VIOLATION:
+		assert(vmcs_read(EXI_QUALIFICATION) & EPT_VLT_WR);
+		assert(vmcs_read(INFO_PHYS_ADDR) ==
+		       virt_to_phys(vmx_rt_ro_page));
+		vmcs_write(GUEST_RIP, vmcs_read(GUEST_RIP) + 2);
+		return;
+	default:
+		assert_msg(false, "Unexpected exit to L1, exit_reason: %s (0x%x)",
+			   exit_reason_description(reason), reason);
+	}
+	skip_exit_insn();
+}
+
+static void __vmx_roundtrip_test(const char *suffix)
+{
+	char name[64];
+	int op;
+
+	test_set_guest(vmx_rt_guest);
+
+	/* Intercept RDMSR and port I/O unconditionally, not RDTSC. */
+	vmcs_clear_bits(CPU_EXEC_CTRL0,
+			CPU_RDTSC | CPU_MSR_BITMAP | CPU_IO_BITMAP);
+	vmcs_set_bits(CPU_EXEC_CTRL0, CPU_IO);
+
+	vmx_rt_ro_page = NULL;
+	if (setup_ept(false)) {
+		report_skip("EPT not supported, no EPT violation round trips");
+	} else {
+		vmx_rt_ro_page = alloc_page();
+		install_ept(pml4, virt_to_phys(vmx_rt_ro_page),
+			    virt_to_phys(vmx_rt_ro_page), EPT_RA);
+	}
+
+	for (op = 0; op < NR_VMX_RT_OPS; op++)
+		stats_hist_init(&vmx_rt_hist[op]);
+	vmx_rt_done = false;
+
+	printf("TSC frequency %" PRIu64 " kHz (%s)\n", tsc_hz() / 1000,
+	       tsc_hz_source());
+
+	for (;;) {
+		enter_guest();
+		if (vmx_rt_done)
+			break;
+		vmx_rt_handle_exit();
+	}
+
+	for (op = 0; op < NR_VMX_RT_OPS; op++) {
+		if (op == VMX_RT_EPT && !vmx_rt_ro_page)
+			continue;
+
+		snprintf(name, sizeof(name), "vmx.%s%s", vmx_rt_names[op],
+			 suffix);
+		tsc_hist_print(name, &vmx_rt_hist[op]);
+		tsc_hist_record(name, cpu_count(), &vmx_rt_hist[op]);
+		report(vmx_rt_hist[op].count == VMX_RT_SAMPLES, "%s", name);
+	}
+}
+
+static void vmx_roundtrip_test(void)
+{
+	if (is_vpid_supported())
+		vmcs_clear_bits(CPU_EXEC_CTRL1, CPU_VPID);
+
+	__vmx_roundtrip_test("");
+}
+
+static void vmx_roundtrip_vpid_test(void)
+{
+	if (!is_vpid_supported())
+		test_skip("VPID unsupported");
+
+	vmcs_set_bits(CPU_EXEC_CTRL0, CPU_SECONDARY);
+	vmcs_set_bits(CPU_EXEC_CTRL1, CPU_VPID);
+	vmcs_write(VPID, 1);
+
+	__vmx_roundtrip_test(".vpid");
+}
+
+/*
+ * Cost of L2 EPT violations that L1 fixes up lazily: L2 writes to every 4K
+ * page of a region whose GPAs are not mapped in L1's EPT, and L1 maps the
+ * 4K, 2M or 1G page around each faulting GPA.  L0 has to shadow L1's EPT,
+ * so every fault is an L2 -> L0 -> L1 -> L0 -> L2 round trip plus the
+ * shadow MMU work for the new mapping.  A second sweep over the region,
+ * now fully mapped, gives the cost of the accesses themselves.
+ */
+#define EPT_FAULT_PERF_GPA	(1ul << 39)
+#define EPT_FAULT_PERF_SIZE	(256ul << 20)
+
+static u8 *ept_fault_perf_gva;
+static u64 ept_fault_perf_hpa;
+static struct stats_hist ept_fault_perf_cold, ept_fault_perf_warm;
+static volatile u64 ept_fault_perf_cold_cycles, ept_fault_perf_warm_cycles;
+static volatile bool ept_fault_perf_done;
+
+static u64 ept_fault_perf_sweep(struct stats_hist *h)
+{
+	u64 start, t, begin = rdtsc();
+	unsigned long i;
+
+	for (i = 0; i < EPT_FAULT_PERF_SIZE; i += PAGE_SIZE) {
+		start = rdtsc();
+		*(volatile unsigned long *)(ept_fault_perf_gva + i) = i;
+		t = rdtsc();
+		stats_hist_add(h, t - start);
+	}
+	return rdtsc() - begin;
+}
+
+static void ept_fault_perf_guest(void)
+{
+	while (!ept_fault_perf_done) {
+		ept_fault_perf_cold_cycles =
+			ept_fault_perf_sweep(&ept_fault_perf_cold);
+		ept_fault_perf_warm_cycles =
+			ept_fault_perf_sweep(&ept_fault_perf_warm);
+		vmcall();
+	}
+}
+
+static void ept_fault_perf_map(int level, u64 gpa)
+{
+	u64 size = 1ul << EPT_LEVEL_SHIFT(level);
+	u64 off = (gpa - EPT_FAULT_PERF_GPA) & ~(size - 1);
+	u64 pte = (ept_fault_perf_hpa + off) | EPT_PRESENT;
+
+	if (level > 1)
+		pte |= EPT_LARGE_PAGE;
+	install_ept_entry(pml4, level, EPT_FAULT_PERF_GPA + off, pte, 0);
+}
+
+static void ept_fault_perf_run(int level, const char *label)
+{
+	u64 page_size = 1ul << EPT_LEVEL_SHIFT(level);
+	unsigned long faults = 0;
+	char name[64];
+	u64 gpa;
+
+	/* Drop the whole region, it has its own PML4 entry. */
+	pml4[EPT_FAULT_PERF_GPA >> EPT_LEVEL_SHIFT(4)] = 0;
+	if (is_invept_type_supported(INVEPT_SINGLE))
+		invept(INVEPT_SINGLE, eptp);
+	else
+		invept(INVEPT_GLOBAL, 0);
+
+	stats_hist_init(&ept_fault_perf_cold);
+	stats_hist_init(&ept_fault_perf_warm);
+
+	for (;;) {
+		enter_guest();
+		if (vmcs_read(EXI_REASON) != VMX_EPT_VIOLATION)
+			break;
+
+		gpa = vmcs_read(INFO_PHYS_ADDR);
+		TEST_ASSERT(gpa >= EPT_FAULT_PERF_GPA &&
+			    gpa < EPT_FAULT_PERF_GPA + EPT_FAULT_PERF_SIZE);
+		ept_fault_perf_map(level, gpa);
+		faults++;
+	}
+	assert_exit_reason(VMX_VMCALL);
+	skip_exit_insn();
+
+	printf("%s: %lu faults, ", label, faults);
+	if (tsc_hz())
+		printf("%" PRIu64 " faults/s, %" PRIu64 " MB/s cold, %" PRIu64
+		       " MB/s warm\n",
+		       (u64)faults * tsc_hz() / ept_fault_perf_cold_cycles,
+		       (EPT_FAULT_PERF_SIZE >> 20) * tsc_hz() /
+		       ept_fault_perf_cold_cycles,
+		       (EPT_FAULT_PERF_SIZE >> 20) * tsc_hz() /
+		       ept_fault_perf_warm_cycles);
+	else
+		printf("%" PRIu64 " cycles cold, %" PRIu64 " cycles warm\n",
+		       ept_fault_perf_cold_cycles, ept_fault_perf_warm_cycles);
+
+	snprintf(name, sizeof(name), "ept_fault.%s", label);
+	tsc_hist_print(name, &ept_fault_perf_cold);
+	tsc_hist_record(name, cpu_count(), &ept_fault_perf_cold);
+	snprintf(name, sizeof(name), "ept_fault.%s.warm", label);
+	tsc_hist_print(name, &ept_fault_perf_warm);
+	tsc_hist_record(name, cpu_count(), &ept_fault_perf_warm);
+
+	/* The region is smaller than a 1G page, but still takes one fault. */
+	report(faults == (EPT_FAULT_PERF_SIZE + page_size - 1) / page_size,
+	       "%s: one EPT violation per page", label);
+}
+
+static void vmx_ept_fault_perf_test(void)
+{
+	unsigned long *page_table = current_page_table();
+	unsigned long pte;
+	void *hva;
+
+	if (setup_ept(false))
+		test_skip("EPT not supported");
+
+	/* The region gets its own PML4 entry, like in the EPT access tests. */
+	if (cpuid_maxphyaddr() < 40)
+		test_skip("Test needs MAXPHYADDR >= 40");
+
+	hva = get_1g_page();
+	TEST_ASSERT(hva);
+	ept_fault_perf_hpa = virt_to_phys(hva);
+
+	ept_fault_perf_gva = alloc_vpages(EPT_FAULT_PERF_SIZE / PAGE_SIZE);
+	install_pages(page_table, EPT_FAULT_PERF_GPA, EPT_FAULT_PERF_SIZE,
+		      ept_fault_perf_gva);
+	TEST_ASSERT(get_ept_pte(pml4, EPT_FAULT_PERF_GPA, 4, &pte) && !pte);
+
+	test_set_guest(ept_fault_perf_guest);
+	ept_fault_perf_done = false;
+
+	printf("TSC frequency %" PRIu64 " kHz (%s)\n", tsc_hz() / 1000,
+	       tsc_hz_source());
+
+	ept_fault_perf_run(1, "4k");
+	if (ept_2m_supported())
+		ept_fault_perf_run(2, "2m");
+	else
+		report_skip("2M EPT pages not supported");
+	if (ept_1g_supported())
+		ept_fault_perf_run(3, "1g");
+	else
+		report_skip("1G EPT pages not supported");
+
+	ept_fault_perf_done = true;
+	enter_guest();
+}
+
 static void vmx_l2_ac_test(void)
 {
 	bool hit_ac = false;
@@ -10772,6 +11341,7 @@ struct vmx_test vmx_tests[] = {
 	TEST(vmx_sipi_signal_test),
 	/* VMCS Shadowing tests */
 	TEST(vmx_vmcs_shadow_test),
+	TEST(vmx_vmcs_shadow_perf_test),
 	/* Regression tests */
 	TEST(vmx_ldtr_test),
 	TEST(vmx_cr_load_test),
@@ -10818,6 +11388,9 @@ struct vmx_test vmx_tests[] = {
 	TEST(vmx_pf_no_vpid_test),
 	TEST(vmx_pf_invvpid_test),
 	TEST(vmx_pf_vpid_test),
+	TEST(vmx_roundtrip_test),
+	TEST(vmx_roundtrip_vpid_test),
+	TEST(vmx_ept_fault_perf_test),
 	TEST(vmx_exception_test),
 	{ NULL, NULL, NULL, NULL, NULL, {0} },
 };